@@ -0,0 +1,532 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#include "sope_encoded_record.h"
+#include "sope_sort.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace sope;
+
+/************************************************
+Microbenchmarks of the kernels of sope_encode.h,
+EncodedRecord put/get and record comparison.
+
+Every encode/decode overload is timed in both
+orders; strings and binaries over value sizes,
+binaries also over the density of 0x00 bytes.
+Record comparison is set against a std::tuple
+comparator over the same rows.
+
+Inputs come from a fixed seed. Each figure is
+the median of 5 runs of at least min_ms each,
+as ns per operation and GB/s of value bytes.
+
+usage: sope_encode_bench [filter] [min_ms]
+  filter: only kernels whose name contains it
+**************************************************/
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t BATCH = 4096;      // values per pass
+const int RUNS = 5;
+const size_t SLACK = 64;        // the SIMD scans may read ahead
+
+const char* gFilter = "";
+double gMinMs = 20;
+uint64_t gSink = 0;             // keeps the results alive
+
+bool selected(const std::string& name) {
+    return name.find(gFilter) != std::string::npos;
+}
+
+/**
+ * Times fn(), one pass over BATCH values (returning a checksum), and
+ * prints the median ns per value and the value bytes per second.
+ */
+template <typename Fn>
+void bench(const std::string& name, const char* order, const std::string& shape,
+           double bytes_per_op, Fn fn) {
+    if (!selected(name)) return;
+    // passes per run, for at least gMinMs
+    size_t passes = 1;
+    while (true) {
+        Clock::time_point t0 = Clock::now();
+        for (size_t k = 0; k < passes; k++) gSink += fn();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - t0).count();
+        if (ms >= gMinMs) break;
+        passes = (ms < gMinMs / 8) ? passes * 8 : passes * 2;
+    }
+    std::vector<double> ns(RUNS);
+    for (int r = 0; r < RUNS; r++) {
+        Clock::time_point t0 = Clock::now();
+        for (size_t k = 0; k < passes; k++) gSink += fn();
+        ns[r] = std::chrono::duration<double, std::nano>(Clock::now() - t0).count()
+                / (passes * BATCH);
+    }
+    std::sort(ns.begin(), ns.end());
+    double med = ns[RUNS / 2];
+    printf("%-28s %-4s %-16s %9.2f ns/op %8.2f GB/s\n", name.c_str(), order,
+           shape.c_str(), med, bytes_per_op / med);
+}
+
+std::mt19937_64 gRng(42);
+
+/*
+ * Fixed-width types: encode() and decode_*() from a pointer and from
+ * a value, over BATCH random values.
+ */
+template <typename T, typename Gen, typename Enc, typename DecP, typename DecV>
+void benchFixed(const char* type, Gen gen, Enc enc, DecP dec_p, DecV dec_v) {
+    typedef decltype(enc(T(), true)) E;
+    std::vector<T> vals(BATCH);
+    for (T& v : vals) v = gen();
+    for (int o = 0; o < 2; o++) {
+        bool asc = (o == 0);
+        const char* order = asc ? "asc" : "desc";
+        std::vector<E> encs(BATCH);
+        for (size_t i = 0; i < BATCH; i++) encs[i] = enc(vals[i], asc);
+        bench(std::string("encode(") + type + ")", order, "", sizeof(T), [&]() {
+            uint64_t s = 0;
+            for (size_t i = 0; i < BATCH; i++) {
+                E e = enc(vals[i], asc);
+                memcpy(&encs[i], &e, sizeof(e));
+                s += (uint64_t)e;
+            }
+            return s;
+        });
+        bench(std::string("decode_") + type + "(ptr)", order, "", sizeof(T), [&]() {
+            uint64_t s = 0;
+            for (size_t i = 0; i < BATCH; i++) s += (uint64_t)dec_p(&encs[i], asc);
+            return s;
+        });
+        bench(std::string("decode_") + type + "(value)", order, "", sizeof(T), [&]() {
+            uint64_t s = 0;
+            for (size_t i = 0; i < BATCH; i++) s += (uint64_t)dec_v(encs[i], asc);
+            return s;
+        });
+    }
+}
+
+/*
+ * Varints of longs: BATCH values of up to `bits` significant bits,
+ * either sign, encoded back to back. bits 0 mixes all magnitudes, so
+ * that the lengths are not predictable.
+ */
+void benchVarints() {
+    for (int bits : {7, 20, 63, 0}) {
+        std::vector<long> vals(BATCH);
+        for (long& v : vals) {
+            int b = bits ? bits : 1 + gRng() % 63;
+            v = (long)(gRng() & ((1ULL << b) - 1));
+            if (gRng() & 1) v = ~v;
+        }
+        std::string shape = bits ? "bits " + std::to_string(bits) : "bits mixed";
+        for (int o = 0; o < 2; o++) {
+            bool asc = (o == 0);
+            const char* order = asc ? "asc" : "desc";
+            std::vector<uint8_t> enc(BATCH * VARINT_MAX_LEN);
+            uint32_t off = 0;
+            for (size_t i = 0; i < BATCH; i++) {
+                off += encode_varint(vals[i], &enc[off], asc);
+            }
+            bench("encode_varint", order, shape, sizeof(long), [&]() {
+                uint64_t off = 0;
+                for (size_t i = 0; i < BATCH; i++) {
+                    off += encode_varint(vals[i], &enc[off], asc);
+                }
+                return off;
+            });
+            bench("get_varint_encoded_len", order, shape, sizeof(long), [&]() {
+                uint64_t s = 0;
+                uint32_t off = 0;
+                for (size_t i = 0; i < BATCH; i++) {
+                    uint32_t len = get_varint_encoded_len(&enc[off], asc);
+                    off += len;
+                    s += len;
+                }
+                return s;
+            });
+            bench("decode_varint", order, shape, sizeof(long), [&]() {
+                uint64_t s = 0;
+                uint32_t off = 0;
+                long v;
+                for (size_t i = 0; i < BATCH; i++) {
+                    off += decode_varint(&enc[off], v, asc);
+                    s += (uint64_t)v;
+                }
+                return s;
+            });
+        }
+    }
+}
+
+/*
+ * Variable-length values: BATCH values of `size` bytes, a fraction
+ * `zeros` of them 0x00 (binaries only), encoded back to back.
+ */
+struct VarData {
+    std::vector<uint8_t>  raw;      // values, size apart
+    std::vector<uint8_t>  enc;      // encoded values
+    std::vector<uint32_t> offsets;  // of each encoded value
+    std::vector<uint8_t>  out;      // decode target
+};
+
+VarData makeVar(uint32_t size, double zeros, bool binary, bool asc) {
+    VarData d;
+    d.raw.resize(BATCH * size + SLACK);
+    std::uniform_real_distribution<double> u(0, 1);
+    for (size_t i = 0; i < BATCH * size; i++) {
+        d.raw[i] = (binary && u(gRng) < zeros) ? 0 : 1 + gRng() % 255;
+    }
+    d.enc.resize(BATCH * (2 * size + BINARY_PAD_LEN) + SLACK);
+    d.offsets.resize(BATCH);
+    uint32_t off = 0;
+    for (size_t i = 0; i < BATCH; i++) {
+        d.offsets[i] = off;
+        if (binary) {
+            off += encode(_SCCV(&d.raw[i * size]), size, &d.enc[off], asc);
+        } else {
+            off += encode(_RC(const char*, &d.raw[i * size]), size, &d.enc[off], asc);
+        }
+    }
+    d.out.resize(BATCH * size + SLACK);
+    return d;
+}
+
+std::string shapeOf(uint32_t size, double zeros, bool binary) {
+    std::string s = "len " + std::to_string(size);
+    if (binary) s += " z " + std::to_string((int)(zeros * 100)) + "%";
+    return s;
+}
+
+void benchStrings() {
+    for (uint32_t size : {8U, 64U, 512U}) {
+        for (int o = 0; o < 2; o++) {
+            bool asc = (o == 0);
+            const char* order = asc ? "asc" : "desc";
+            VarData d = makeVar(size, 0, false, asc);
+            std::string shape = shapeOf(size, 0, false);
+            bench("encode(string)", order, shape, size, [&]() {
+                uint64_t s = 0;
+                for (size_t i = 0; i < BATCH; i++) {
+                    s += encode(_RC(const char*, &d.raw[i * size]), size,
+                                &d.enc[d.offsets[i]], asc);
+                }
+                return s;
+            });
+            bench("get_string_len", order, shape, size, [&]() {
+                uint64_t s = 0;
+                for (size_t i = 0; i < BATCH; i++) {
+                    s += get_string_len(&d.enc[d.offsets[i]], asc);
+                }
+                return s;
+            });
+            bench("decode_string", order, shape, size, [&]() {
+                uint64_t s = 0;
+                for (size_t i = 0; i < BATCH; i++) {
+                    s += decode_string(&d.enc[d.offsets[i]], &d.out[i * size], asc);
+                }
+                return s;
+            });
+            if (asc) {
+                bench("calc_string_encoded_len", "", shape, size, [&]() {
+                    uint64_t s = 0;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        s += calc_string_encoded_len(size + (uint32_t)(i & 1));
+                    }
+                    return s;
+                });
+            }
+        }
+    }
+}
+
+void benchBinaries() {
+    for (uint32_t size : {8U, 64U, 512U}) {
+        for (double zeros : {0.0, 0.01, 0.25}) {
+            for (int o = 0; o < 2; o++) {
+                bool asc = (o == 0);
+                const char* order = asc ? "asc" : "desc";
+                VarData d = makeVar(size, zeros, true, asc);
+                std::string shape = shapeOf(size, zeros, true);
+                bench("encode(binary)", order, shape, size, [&]() {
+                    uint64_t s = 0;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        s += encode(_SCCV(&d.raw[i * size]), size,
+                                    &d.enc[d.offsets[i]], asc);
+                    }
+                    return s;
+                });
+                if (asc) {
+                    bench("calc_binary_encoded_len", "", shape, size, [&]() {
+                        uint64_t s = 0;
+                        for (size_t i = 0; i < BATCH; i++) {
+                            s += calc_binary_encoded_len(&d.raw[i * size], size);
+                        }
+                        return s;
+                    });
+                    bench("get_unescaped_bytes_len", order, shape, size, [&]() {
+                        uint64_t s = 0;
+                        uint32_t len;
+                        for (size_t i = 0; i < BATCH; i++) {
+                            s += get_unescaped_bytes_len(&d.enc[d.offsets[i]], len);
+                        }
+                        return s;
+                    });
+                }
+                bench("get_bytes_len", order, shape, size, [&]() {
+                    uint64_t s = 0;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        s += get_bytes_len(&d.enc[d.offsets[i]], asc);
+                    }
+                    return s;
+                });
+                bench("get_bytes_encoded_len", order, shape, size, [&]() {
+                    uint64_t s = 0;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        s += get_bytes_encoded_len(&d.enc[d.offsets[i]], asc);
+                    }
+                    return s;
+                });
+                bench("decode_bytes", order, shape, size, [&]() {
+                    uint64_t s = 0;
+                    uint32_t len;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        s += decode_bytes(&d.enc[d.offsets[i]], &d.out[i * size],
+                                          len, asc);
+                    }
+                    return s;
+                });
+                // the same values in fixed groups (size is a multiple
+                // of GROUP_LEN, so a decode writes only its own bytes)
+                uint32_t glen = calc_group_encoded_len(size);
+                std::vector<uint8_t> genc(BATCH * glen);
+                bench("encode_group", order, shape, size, [&]() {
+                    uint64_t s = 0;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        s += encode_group(&d.raw[i * size], size,
+                                          &genc[i * glen], asc);
+                    }
+                    return s;
+                });
+                bench("get_group_encoded_len", order, shape, size, [&]() {
+                    uint64_t s = 0;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        s += get_group_encoded_len(&genc[i * glen], asc);
+                    }
+                    return s;
+                });
+                bench("decode_group", order, shape, size, [&]() {
+                    uint64_t s = 0;
+                    uint32_t len;
+                    for (size_t i = 0; i < BATCH; i++) {
+                        s += decode_group(&genc[i * glen], &d.out[i * size],
+                                          len, asc);
+                    }
+                    return s;
+                });
+            }
+        }
+    }
+}
+
+/*
+ * Rows (int, long desc, string, double) through EncodedRecord, and
+ * their comparison: comp(), compareKeys(), and a std::tuple of the
+ * native values with the same order.
+ */
+struct Row {
+    int         i;
+    long        l;
+    std::string s;
+    double      d;
+};
+
+uint32_t putRow(EncodedRecord& rec, const Row& r) {
+    rec.resetPos();
+    rec.putNotNullFieldIndicator(true);
+    rec.put(r.i, true);
+    rec.putNotNullFieldIndicator(false);
+    rec.put(r.l, false);
+    rec.putNotNullFieldIndicator(true);
+    rec.put(r.s.data(), (uint32_t)r.s.size(), true);
+    rec.putNotNullFieldIndicator(true);
+    rec.put(r.d, true);
+    rec.setEndPos();
+    return rec.getEndPos();
+}
+
+// the order of the encoded rows: long descending
+typedef std::tuple<int, long, const std::string&, double> RowTuple;
+RowTuple tupleOf(const Row& r) {
+    return RowTuple(r.i, -r.l, r.s, r.d);
+}
+
+void benchRecords() {
+    const uint32_t ROW_BUF = 64;
+    std::vector<Row> rows(BATCH);
+    for (Row& r : rows) {
+        r.i = (int)(gRng() % 16);           // ties go on to the next fields
+        r.l = (long)(gRng() % 1000) - 500;
+        r.s = "name_" + std::to_string(gRng() % 100);
+        r.d = (double)(gRng() % 1000) / 8;
+    }
+    std::vector<uint8_t> buf(BATCH * ROW_BUF);
+    std::vector<EncodedRecord> recs;
+    recs.reserve(BATCH);
+    for (size_t k = 0; k < BATCH; k++) {
+        recs.emplace_back(&buf[k * ROW_BUF], ROW_BUF);
+        putRow(recs[k], rows[k]);
+    }
+    double row_bytes = 0;
+    for (const EncodedRecord& r : recs) row_bytes += r.getEndPos();
+    row_bytes /= BATCH;
+
+    bench("EncodedRecord put row", "", "4 fields", row_bytes, [&]() {
+        uint64_t s = 0;
+        for (size_t k = 0; k < BATCH; k++) s += putRow(recs[k], rows[k]);
+        return s;
+    });
+    bench("EncodedRecord get row", "", "4 fields", row_bytes, [&]() {
+        uint64_t s = 0;
+        uint32_t len;
+        for (size_t k = 0; k < BATCH; k++) {
+            EncodedRecord& rec = recs[k];
+            rec.resetPos();
+            rec.checkNullFieldIndicator(true);
+            s += rec.getInt(true);
+            rec.checkNullFieldIndicator(false);
+            s += rec.getLong(false);
+            rec.checkNullFieldIndicator(true);
+            s += (uintptr_t)rec.getStringView(len, true) + len;
+            rec.checkNullFieldIndicator(true);
+            s += (uint64_t)rec.getDouble(true);
+        }
+        return s;
+    });
+
+    // random pairs, the same for every comparator
+    std::vector<uint32_t> pairs(2 * BATCH);
+    for (uint32_t& p : pairs) p = gRng() % BATCH;
+    bench("comp", "", "record pair", row_bytes, [&]() {
+        uint64_t s = 0;
+        for (size_t k = 0; k < BATCH; k++) {
+            s += comp(&recs[pairs[2 * k]], &recs[pairs[2 * k + 1]]);
+        }
+        return s;
+    });
+    bench("compareKeys", "", "record pair", row_bytes, [&]() {
+        uint64_t s = 0;
+        for (size_t k = 0; k < BATCH; k++) {
+            s += compareKeys(&recs[pairs[2 * k]], &recs[pairs[2 * k + 1]]) < 0;
+        }
+        return s;
+    });
+    bench("std::tuple <", "", "row pair", row_bytes, [&]() {
+        uint64_t s = 0;
+        for (size_t k = 0; k < BATCH; k++) {
+            s += tupleOf(rows[pairs[2 * k]]) < tupleOf(rows[pairs[2 * k + 1]]);
+        }
+        return s;
+    });
+
+    // sorting the batch: per element
+    std::vector<EncodedRecord*> ptrs(BATCH);
+    std::vector<const Row*> row_ptrs(BATCH);
+    bench("std::sort comp", "", "4096 records", row_bytes, [&]() {
+        for (size_t k = 0; k < BATCH; k++) ptrs[k] = &recs[pairs[k]];
+        std::sort(ptrs.begin(), ptrs.end(), comp);
+        return (uint64_t)(uintptr_t)ptrs[0];
+    });
+    bench("std::sort std::tuple", "", "4096 rows", row_bytes, [&]() {
+        for (size_t k = 0; k < BATCH; k++) row_ptrs[k] = &rows[pairs[k]];
+        std::sort(row_ptrs.begin(), row_ptrs.end(),
+                  [](const Row* a, const Row* b) {
+                      return tupleOf(*a) < tupleOf(*b);
+                  });
+        return (uint64_t)(uintptr_t)row_ptrs[0];
+    });
+    // check that both orders agree
+    for (size_t k = 0; k < BATCH; k++) {
+        ptrs[k] = &recs[pairs[k]];
+        row_ptrs[k] = &rows[pairs[k]];
+    }
+    std::sort(ptrs.begin(), ptrs.end(), comp);
+    std::sort(row_ptrs.begin(), row_ptrs.end(),
+              [](const Row* a, const Row* b) { return tupleOf(*a) < tupleOf(*b); });
+    uint8_t expect_buf[ROW_BUF];
+    for (size_t k = 0; k < BATCH; k++) {
+        EncodedRecord expect(expect_buf, ROW_BUF);
+        putRow(expect, *row_ptrs[k]);
+        if (compareKeys(ptrs[k], &expect) != 0) {
+            printf("encoded and tuple orders differ\n");
+            exit(1);
+        }
+    }
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    if (argc > 1) gFilter = argv[1];
+    if (argc > 2) gMinMs = atof(argv[2]);
+
+    benchFixed<int>("int",
+        []() { return (int)gRng(); },
+        [](int v, bool asc) { return encode(v, asc); },
+        [](const void* p, bool asc) { return decode_int(p, asc); },
+        [](uint32_t v, bool asc) { return decode_int(v, asc); });
+    benchFixed<long>("long",
+        []() { return (long)gRng(); },
+        [](long v, bool asc) { return encode(v, asc); },
+        [](const void* p, bool asc) { return decode_long(p, asc); },
+        [](uint64_t v, bool asc) { return decode_long(v, asc); });
+    benchFixed<Date>("date",
+        []() { return (Date)(gRng() % 4000000000000ULL); },
+        [](Date v, bool asc) { return encode((long)v, asc); },
+        [](const void* p, bool asc) { return decode_date(p, asc); },
+        [](uint64_t v, bool asc) { return decode_date(v, asc); });
+    benchFixed<Timestamp>("timestamp",
+        []() { return (Timestamp)gRng(); },
+        [](Timestamp v, bool asc) { return encode(v, asc); },
+        [](const void* p, bool asc) { return decode_timestamp(p, asc); },
+        [](uint64_t v, bool asc) {
+            return decode_timestamp(&v, asc);   // no value overload
+        });
+    benchFixed<double>("double",
+        []() { return (double)(long)gRng() / 3; },
+        [](double v, bool asc) { return encode(v, asc); },
+        [](const void* p, bool asc) { return decode_double(p, asc); },
+        [](uint64_t v, bool asc) { return decode_double(v, asc); });
+    benchVarints();
+    benchStrings();
+    benchBinaries();
+    benchRecords();
+
+    // print the sink so that no loop is optimized away
+    fflush(stdout);
+    fprintf(stderr, "checksum %llu\n", (unsigned long long)gSink);
+    return 0;
+}
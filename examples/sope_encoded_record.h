@@ -101,14 +101,18 @@ public:
         , endPos(0)
         , curLen(0)
         , pWorkingBuf(nullptr)
-        , lenWorkingBuf(0) { }
+        , lenWorkingBuf(0)
+        , growing(false)
+        , owned(true) { }
 
     EncodedRecord(size_t sz)
         : curPos(0)
         , endPos(0)
         , curLen(sz)
         , pWorkingBuf(nullptr)
-        , lenWorkingBuf(0) {
+        , lenWorkingBuf(0)
+        , growing(false)
+        , owned(true) {
         pData = (uint8_t *) malloc(sz);
     }
 
@@ -119,7 +123,9 @@ public:
         , endPos(len)
         , curLen(len)
         , pWorkingBuf(nullptr)
-        , lenWorkingBuf(0) {}
+        , lenWorkingBuf(0)
+        , growing(false)
+        , owned(false) {}
 
     ~EncodedRecord() {
         // Should not free pData in destructor,
@@ -138,6 +144,7 @@ public:
         pData = (uint8_t *) malloc((size_t) sz);
         curPos = 0;
         curLen = sz;
+        owned = true;
     }
 
     void resize(size_t new_sz) {
@@ -151,6 +158,18 @@ public:
         } // Otherwise, realloc failed.
     }
 
+    // Growing sink: the put methods make room for what they write,
+    // doubling the buffer when it is full, so a record can be encoded
+    // without knowing its size. The buffer must be owned by the record
+    // (default constructed, EncodedRecord(size_t) or alloc()), as it is
+    // moved by realloc; freeInternals() frees it. setData() borrows
+    // memory and turns growing off.
+    void setGrowing(bool on = true) {
+        assert(!on || owned);
+        growing = on;
+    }
+    bool isGrowing() const { return growing; }
+
     void freeInternals() {
         if (pData) {
             ::free(pData);
@@ -165,34 +184,41 @@ public:
     }
 
     void putNullFieldIndicator(bool asc = true) {
+        room(LEN_NULL);
         *_RC(uint8_t*, pData + curPos) = asc ? NULL_ASC : NULL_DESC;
         curPos += LEN_NULL;
     }
     void putNotNullFieldIndicator(bool asc = true) {
+        room(LEN_NULL);
         *_RC(uint8_t*, pData + curPos) = asc ? NOT_NULL_ASC : NOT_NULL_DESC;
         curPos += LEN_NULL;
     }
     void putNullConditionIndicator(bool start = true) {
+        room(LEN_NULL);
         *_RC(uint8_t*, pData + curPos) = start ? NULL_COND_START : NULL_COND_END;
         curPos += LEN_NULL;
     }
     void putNotNullConditionIndicator(bool asc = true) {
+        room(LEN_NULL);
         *_RC(uint8_t*, pData + curPos) = asc
                                          ? NOT_NULL_COND_ASC
                                          : NOT_NULL_COND_DESC;
         curPos += LEN_NULL;
     }
     void putNullPointConditionIndicator(bool asc = true) {
+        room(LEN_NULL);
         *_RC(uint8_t*, pData + curPos) = asc
                                          ? NULL_POINT_COND_ASC
                                          : NULL_POINT_COND_DESC;
         curPos += LEN_NULL;
     }
     void put(int i, bool asc = true) {
+        room(LEN_INT);
         *_RC(uint32_t*, pData+curPos) = encode(i, asc);
         curPos += LEN_INT;
     }
     void put(long l, bool asc = true) {
+        room(LEN_LONG);
         *_RC(uint64_t*, pData+curPos) = encode(l, asc);
         curPos += LEN_LONG;
     }
@@ -201,32 +227,58 @@ public:
     // Mac reports ambiguity between long and Date.
     // Need to explicitly separate them.
     void put(Date l, bool asc = true) {
+        room(LEN_LONG);
         *_RC(uint64_t*, pData+curPos) = encode((long)l, asc);
         curPos += LEN_LONG;
     }
 #endif
 
     void put(double d, bool asc = true) {
+        room(LEN_DOUBLE);
         *_RC(uint64_t*, pData+curPos) = encode(d, asc);
         curPos += LEN_DOUBLE;
     }
     void put(bool b, bool asc = true) {
+        room(LEN_BOOL);
         *_RC(bool*, pData+curPos) = asc ? b : !b;
         curPos += LEN_BOOL;
+        SOPE_STAT_ENCODED(KIND_BOOL, 1, LEN_BOOL);
     }
     void put(Timestamp ts, bool asc = true) {
+        room(LEN_TIMESTAMP);
         *_RC(Timestamp*, pData+curPos) = encode(ts, asc);
         curPos += LEN_TIMESTAMP;
     }
     void put(const char * p, uint32_t len, bool asc = true) {
+        room((size_t)len + STRING_PAD_LEN);
         uint32_t enclen = encode(p, len, pData+curPos, asc);
         curPos += enclen;
     }
     void put(const void * p, uint32_t len, bool asc = true) {
+        // at most every byte escaped, without counting them first
+        room(2 * (size_t)len + BINARY_PAD_LEN);
         uint32_t enclen = encode(p, len, pData+curPos, asc);
         curPos += enclen;
     }
 
+    // fixed-group format of strings and binaries (ENCODING_GROUP)
+    void putGroup(const void * p, uint32_t len, bool asc = true) {
+        room(calc_group_encoded_len(len));
+        curPos += encode_group(p, len, pData+curPos, asc);
+    }
+
+    // variable-length integers (ENCODING_VARINT): int, long and Date
+    // with putVarint(), Timestamp with putUVarint()
+    void putVarint(long l, bool asc = true) {
+        room(VARINT_MAX_LEN);
+        curPos += encode_varint(l, pData+curPos, asc);
+    }
+
+    void putUVarint(uint64_t u, bool asc = true) {
+        room(VARINT_MAX_LEN);
+        curPos += encode_uvarint(u, pData+curPos, asc);
+    }
+
     bool checkNullFieldIndicator(bool asc = true) {
         bool is_null = (*_RC(uint8_t*, pData+curPos)
                         ==(asc ? NULL_ASC : NULL_DESC));
@@ -255,6 +307,7 @@ public:
     bool getBool(bool asc = true) {
         bool b = *_RC(bool*, pData+curPos);
         curPos += LEN_BOOL;
+        SOPE_STAT_DECODED(KIND_BOOL, 1, LEN_BOOL);
         return b;
     }
 
@@ -286,6 +339,161 @@ public:
         return pWorkingBuf;
     }
 
+    long getVarint(bool asc = true) {
+        long l;
+        curPos += decode_varint(pData+curPos, l, asc);
+        return l;
+    }
+
+    uint64_t getUVarint(bool asc = true) {
+        uint64_t u;
+        curPos += decode_uvarint(pData+curPos, u, asc);
+        return u;
+    }
+
+    // the decoded value of putGroup(), in the working buffer
+    // (GROUP_LEN bytes per group, whole groups are written)
+    uint8_t* getGroup(uint32_t& len, bool asc = true) {
+        getWorkingBuf(get_group_encoded_len(pData+curPos, asc)
+                      / (GROUP_LEN + 1) * GROUP_LEN);
+        curPos += decode_group(pData+curPos, pWorkingBuf, len, asc);
+        return pWorkingBuf;
+    }
+
+    // Views: same as getString/getBinary, but without a copy when the
+    // encoded bytes are the value itself, i.e. for an ascending string
+    // and an ascending binary without 0x00 bytes. The result then
+    // points into the record data (not NUL-terminated). Descending
+    // and escaped values are still decoded into the working buffer.
+    const char* getStringView(uint32_t& len, bool asc = true) {
+        if (!asc) return getString(len, asc);
+        const char* p = _RC(const char*, pData+curPos);
+        len = get_string_len(p, true);
+        curPos += len + STRING_PAD_LEN;
+        SOPE_STAT_DECODED(KIND_STRING, 1, len + STRING_PAD_LEN);
+        return p;
+    }
+
+    const uint8_t* getBinaryView(uint32_t& len, bool asc = true) {
+        if (!asc || !get_unescaped_bytes_len(pData+curPos, len)) {
+            return getBinary(len, asc);
+        }
+        const uint8_t* p = pData+curPos;
+        curPos += len + BINARY_PAD_LEN;
+        SOPE_STAT_DECODED(KIND_BINARY, 1, len + BINARY_PAD_LEN);
+        return p;
+    }
+
+    // Skip primitives: advance past a value, or a field (indicator and
+    // value), without decoding it. Strings and binaries are scanned for
+    // their terminator only.
+    void skipValue(Type t, bool asc = true, Encoding enc = ENCODING_DEFAULT) {
+        curPos += valueLen(pData+curPos, t, asc, enc);
+    }
+
+    void skipField(Type t, bool asc = true, Encoding enc = ENCODING_DEFAULT) {
+        if (!checkNullFieldIndicator(asc)) skipValue(t, asc, enc);
+    }
+
+    // Bytes taken by the value at p (after its indicator), as skipped
+    // by skipValue().
+    static uint32_t valueLen(const uint8_t* p, Type t, bool asc = true,
+                             Encoding enc = ENCODING_DEFAULT) {
+        if (enc == ENCODING_GROUP) return get_group_encoded_len(p, asc);
+        if (enc == ENCODING_VARINT) return get_varint_encoded_len(p, asc);
+        switch (t) {
+        case TYPE_STRING:
+            return get_string_len(p, asc) + STRING_PAD_LEN;
+        case TYPE_BINARY:
+        case TYPE_OBJECT:
+            return get_bytes_encoded_len(p, asc);
+        case TYPE_NULL:
+            return 0;
+        default:
+            return Typelen(t);
+        }
+    }
+
+    // Bytes taken by the field at p, indicator included.
+    static uint32_t fieldLen(const uint8_t* p, Type t, bool asc = true,
+                             Encoding enc = ENCODING_DEFAULT) {
+        if (*p == (asc ? NULL_ASC : NULL_DESC)) return LEN_NULL;
+        return LEN_NULL + valueLen(p + LEN_NULL, t, asc, enc);
+    }
+
+    // As fieldLen(), but within avail bytes, e.g. of a condition key
+    // that may end before the field does: false if the field is not
+    // all there, or p holds no field indicator (after a range, a key
+    // can hold a bare indicator followed by 0x00/0xFF).
+    static bool fieldLen(const uint8_t* p, uint32_t avail, Type t, bool asc,
+                         Encoding enc, uint32_t& len) {
+        if (avail == 0) return false;
+        if (*p == (asc ? NULL_ASC : NULL_DESC)) {
+            len = LEN_NULL;
+            return true;
+        }
+        if (*p != (asc ? NOT_NULL_ASC : NOT_NULL_DESC)) return false;
+        uint32_t i = LEN_NULL;
+        if (enc == ENCODING_GROUP) {
+            // up to the first marker that is not GROUP_MARKER_MORE
+            uint8_t more = asc ? GROUP_MARKER_MORE : (uint8_t)~GROUP_MARKER_MORE;
+            for (i += GROUP_LEN; i < avail; i += GROUP_LEN + 1) {
+                if (p[i] != more) {
+                    len = i + 1;
+                    return true;
+                }
+            }
+            return false;
+        }
+        if (enc == ENCODING_VARINT) {
+            if (avail <= i) return false;
+            len = i + get_varint_encoded_len(p + i, asc);
+            return len <= avail;
+        }
+        uint8_t end = asc ? 0x00 : 0xFF;
+        switch (t) {
+        case TYPE_STRING:
+            // terminated by the first end-end pair
+            for (; i + 1 < avail; i++) {
+                if (p[i] == end && p[i + 1] == end) {
+                    len = i + STRING_PAD_LEN;
+                    return true;
+                }
+            }
+            return false;
+        case TYPE_BINARY:
+        case TYPE_OBJECT:
+            // an end byte is an escape (followed by ~end) or the end
+            for (; i + 1 < avail; i++) {
+                if (p[i] != end) continue;
+                if (p[i + 1] == end) {
+                    len = i + BINARY_PAD_LEN;
+                    return true;
+                }
+                if (p[i + 1] != (uint8_t)~end) return false;
+                i++;
+            }
+            return false;
+        case TYPE_NULL:
+            len = LEN_NULL;
+            return true;
+        default:
+            len = LEN_NULL + Typelen(t);
+            return len <= avail;
+        }
+    }
+
+    // switch to another record's data, e.g. space reserved in a
+    // RecordArena; the working buffer is kept for reuse
+    void setData(void* pdata, uint32_t len) {
+        pData = _SCU(pdata);
+        curPos = 0;
+        endPos = len;
+        curLen = len;
+        growing = false;
+        owned = false;
+    }
+
     void setEndPos() { endPos = curPos; }
     int  getEndPos() const { return endPos; }
 
@@ -298,12 +506,27 @@ public:
         curPos = 0;
         endPos = 0;
         curLen = 0;
+        owned = true;
     }
 
 private:
+    // room for n more bytes in a growing record
+    void room(size_t n) {
+        if (growing && curPos + n > curLen) grow(curPos + n);
+    }
+
+    void grow(size_t need) {
+        size_t sz = curLen ? curLen : 64;
+        while (sz < need) sz *= 2;
+        resize(sz);
+        // the puts write unchecked: out of memory is fatal here
+        if (curLen < need) abort();
+    }
+
     void getWorkingBuf(uint32_t len) {
         if (pWorkingBuf != nullptr && lenWorkingBuf >= len) return;
         if (pWorkingBuf != nullptr && lenWorkingBuf < len) ::free(pWorkingBuf);
+        SOPE_STAT_WORKING_BUF(len);
         pWorkingBuf = (uint8_t *) malloc((size_t) len);
         lenWorkingBuf = len;
     }
@@ -314,6 +537,8 @@ private:
     uint32_t  curLen;
     uint8_t*  pWorkingBuf;
     uint32_t  lenWorkingBuf;
+    bool      growing;
+    bool      owned;        // pData may be realloc'ed
 };
 
 /* inline bool comp(const EncodedRecord& r1, const EncodedRecord& r2) {
@@ -0,0 +1,400 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace sope {
+
+/**
+ * External merge sort of encoded keys.
+ *
+ *   ExternalSorter sorter(256 << 20, "/data/tmp");
+ *   for (...) sorter.add(pr);       // EncodedRecord, or (key, len)
+ *   sorter.finish();
+ *   const uint8_t* key; uint32_t len;
+ *   while (sorter.next(key, len)) { ... }
+ *
+ * Keys are copied into an in-memory batch. When the batch reaches the
+ * memory budget it is sorted and written to a run file as a sequence
+ * of [uint32 length][key bytes]. The batch is a single allocation of
+ * the budget, keys filling it from the front and their sort entries
+ * from the back, so it never grows past the budget whatever the key
+ * lengths; a key too long for an empty batch is a run of its own.
+ * finish() sorts the last batch; if nothing was spilled, next() walks
+ * it directly. Otherwise the runs
+ * are merged with a loser tree, so that each key costs about log2(k)
+ * comparisons for k runs.
+ *
+ * The merge reads every run through its own buffer. With more runs
+ * than the budget has buffers for (MIN_RUN_BUF bytes each), groups of
+ * runs are first merged into longer runs, so memory stays within the
+ * budget and all file I/O is sequential.
+ *
+ * Keys order as in sope_sort.h: memcmp, then the shorter key first.
+ * Run files are created in tmp_dir and unlinked right away, so they
+ * go away with the sorter, or with the process.
+ *
+ * add() and finish() return false on I/O errors, after which the
+ * sorter is unusable; next() then returns false and failed() is true.
+ */
+class ExternalSorter {
+public:
+    static const size_t MIN_RUN_BUF = 64 * 1024;
+
+    ExternalSorter(size_t mem_budget, const std::string& tmp_dir = "/tmp")
+        : budget(std::max(mem_budget, 2 * MIN_RUN_BUF))
+        , tmpDir(tmp_dir)
+        , mem(nullptr)
+        , keyEnd(0)
+        , entryBegin(nullptr)
+        , entryEnd(nullptr)
+        , finished(false)
+        , error(false)
+        , cursor(0) {}
+
+    ~ExternalSorter() {
+        free(mem);
+        closeRuns(runs);
+        closeRuns(merging);
+        closeRuns(nextRuns);
+    }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    bool add(const void* key, uint32_t len) {
+        if (error || finished) return false;
+        if (!mem && !allocBatch()) return false;
+        if (!fits(len)) {
+            if (entryBegin != entryEnd && !spill()) return false;
+            if (!fits(len)) {
+                return writeRun(_RC(const uint8_t*, key), len);
+            }
+        }
+        Entry* e = --entryBegin;
+        e->offset = keyEnd;
+        e->len = len;
+        e->prefix = prefixOf(_RC(const uint8_t*, key), len);
+        if (len) memcpy(mem + keyEnd, key, len);
+        keyEnd += len;
+        return true;
+    }
+
+    bool add(const EncodedRecord* pr) {
+        return add(pr->getData(), (uint32_t)pr->getEndPos());
+    }
+
+    // No more add() after this; next() returns keys in order.
+    bool finish() {
+        if (error || finished) return !error;
+        finished = true;
+        if (runs.empty()) {
+            sortBatch();
+            return true;
+        }
+        if (entryBegin != entryEnd && !spill()) return false;
+        return prepareMerge();
+    }
+
+    // The key stays valid until the next call.
+    bool next(const uint8_t*& key, uint32_t& len) {
+        if (error || !finished) return false;
+        if (runs.empty() && merging.empty()) {
+            if (entryBegin + cursor == entryEnd) return false;
+            const Entry& e = entryBegin[cursor++];
+            key = mem + e.offset;
+            len = e.len;
+            return true;
+        }
+        return merger.next(key, len, error);
+    }
+
+    size_t getNumRuns() const { return runs.size() + merging.size(); }
+    bool failed() const { return error; }
+
+private:
+    struct Entry {
+        uint64_t prefix;    // first 8 bytes, big-endian, zero padded
+        size_t   offset;
+        uint32_t len;
+    };
+
+    // sequential reader over one run file
+    class RunReader {
+    public:
+        RunReader() : fp(nullptr), pos(0), end(0), eof(false) {}
+
+        void open(FILE* f, size_t buf_len) {
+            fp = f;
+            buf.resize(buf_len);
+            pos = end = 0;
+            eof = false;
+        }
+
+        // false at the end of the run, or on error (err set)
+        bool read(const uint8_t*& key, uint32_t& len, bool& err) {
+            if (!fill(sizeof(uint32_t), err)) return false;
+            memcpy(&len, &buf[pos], sizeof(uint32_t));
+            if (!fill(sizeof(uint32_t) + len, err)) return false;
+            key = &buf[pos + sizeof(uint32_t)];
+            pos += sizeof(uint32_t) + len;
+            return true;
+        }
+
+    private:
+        // makes at least n bytes available at pos
+        bool fill(size_t n, bool& err) {
+            if (end - pos >= n) return true;
+            memmove(&buf[0], &buf[pos], end - pos);
+            end -= pos;
+            pos = 0;
+            if (buf.size() < n) buf.resize(n);
+            while (!eof && end < n) {
+                size_t got = fread(&buf[end], 1, buf.size() - end, fp);
+                if (got == 0) {
+                    if (ferror(fp)) err = true;
+                    eof = true;
+                }
+                end += got;
+            }
+            if (end == 0) return false;
+            if (end < n) err = true;    // truncated run
+            return end >= n;
+        }
+
+        FILE*                fp;
+        std::vector<uint8_t> buf;
+        size_t               pos;
+        size_t               end;
+        bool                 eof;
+    };
+
+    /**
+     * Loser tree over k runs: tree[0] is the current winner, and each
+     * inner node holds the loser of the match played there. After the
+     * winner is consumed, only its path to the root is replayed.
+     * An exhausted run loses against everything.
+     */
+    class Merger {
+    public:
+        void open(std::vector<FILE*>& files, size_t buf_len) {
+            k = files.size();
+            readers.assign(k, RunReader());
+            cur.assign(k, Cur());
+            tree.assign(k, k);      // k is the winner of an empty match
+            started = false;
+            for (size_t i = 0; i < k; i++) {
+                rewind(files[i]);
+                readers[i].open(files[i], buf_len);
+            }
+        }
+
+        bool next(const uint8_t*& key, uint32_t& len, bool& err) {
+            if (!started) {
+                started = true;
+                for (size_t i = 0; i < k; i++) advance(i, err);
+                for (size_t i = k; i-- > 0; ) replay(i);
+            } else {
+                // the winner returned last time is consumed now, so
+                // its key stayed valid until this call
+                advance(tree[0], err);
+                replay(tree[0]);
+            }
+            if (err) return false;
+            const Cur& c = cur[tree[0]];
+            if (!c.valid) return false;
+            key = c.key;
+            len = c.len;
+            return true;
+        }
+
+    private:
+        struct Cur {
+            const uint8_t* key;
+            uint32_t       len;
+            bool           valid;
+            Cur() : key(nullptr), len(0), valid(false) {}
+        };
+
+        void advance(size_t i, bool& err) {
+            cur[i].valid = readers[i].read(cur[i].key, cur[i].len, err);
+        }
+
+        // true if run a wins over run b
+        bool beats(size_t a, size_t b) const {
+            if (b == k) return false;
+            if (a == k) return true;
+            const Cur& x = cur[a];
+            const Cur& y = cur[b];
+            if (!y.valid) return x.valid || a < b;
+            if (!x.valid) return false;
+            int c = memcmp(x.key, y.key, std::min(x.len, y.len));
+            if (c != 0) return c < 0;
+            if (x.len != y.len) return x.len < y.len;
+            return a < b;       // equal keys in run order
+        }
+
+        void replay(size_t s) {
+            for (size_t t = (s + k) / 2; t > 0; t /= 2) {
+                if (beats(tree[t], s)) std::swap(s, tree[t]);
+            }
+            tree[0] = s;
+        }
+
+        size_t                 k;
+        std::vector<RunReader> readers;
+        std::vector<Cur>       cur;
+        std::vector<size_t>    tree;
+        bool                   started;
+    };
+
+    static uint64_t prefixOf(const uint8_t* key, uint32_t len) {
+        uint64_t v = 0;
+        memcpy(&v, key, std::min(len, (uint32_t)sizeof(v)));
+        return _dec64(v);
+    }
+
+    // budget bytes, with room for whole entries at the back
+    bool allocBatch() {
+        mem = _RC(uint8_t*, malloc(budget));
+        if (!mem) return fail();
+        entryEnd = _RC(Entry*, mem + budget / sizeof(Entry) * sizeof(Entry));
+        entryBegin = entryEnd;
+        return true;
+    }
+
+    bool fits(uint32_t len) const {
+        return keyEnd + len + sizeof(Entry) <=
+               (size_t)(_RC(uint8_t*, entryBegin) - mem);
+    }
+
+    void sortBatch() {
+        const uint8_t* base = mem;
+        std::sort(entryBegin, entryEnd,
+                  [base](const Entry& a, const Entry& b) {
+                      if (a.prefix != b.prefix) return a.prefix < b.prefix;
+                      int c = memcmp(base + a.offset, base + b.offset,
+                                     std::min(a.len, b.len));
+                      if (c != 0) return c < 0;
+                      return a.len < b.len;
+                  });
+    }
+
+    FILE* newRunFile() {
+        std::string path = tmpDir + "/sope_run_XXXXXX";
+        int fd = mkstemp(&path[0]);
+        if (fd < 0) return nullptr;
+        unlink(path.c_str());
+        FILE* fp = fdopen(fd, "w+b");
+        if (!fp) close(fd);
+        return fp;
+    }
+
+    static bool writeKey(FILE* fp, const uint8_t* key, uint32_t len) {
+        return fwrite(&len, sizeof(len), 1, fp) == 1 &&
+               fwrite(key, 1, len, fp) == len;
+    }
+
+    // sorts the batch and writes it as a new run
+    bool spill() {
+        sortBatch();
+        FILE* fp = newRunFile();
+        if (!fp) return fail();
+        runs.push_back(fp);
+        for (const Entry* e = entryBegin; e != entryEnd; e++) {
+            if (!writeKey(fp, mem + e->offset, e->len)) return fail();
+        }
+        if (fflush(fp) != 0) return fail();
+        entryBegin = entryEnd;
+        keyEnd = 0;
+        return true;
+    }
+
+    // writes a run of just this key
+    bool writeRun(const uint8_t* key, uint32_t len) {
+        FILE* fp = newRunFile();
+        if (!fp) return fail();
+        runs.push_back(fp);
+        if (!writeKey(fp, key, len) || fflush(fp) != 0) return fail();
+        return true;
+    }
+
+    // merges runs until one pass over all of them fits the budget
+    bool prepareMerge() {
+        // the batch is not needed during the merge
+        free(mem);
+        mem = nullptr;
+        entryBegin = entryEnd = nullptr;
+        keyEnd = 0;
+        size_t fan_in = std::max(budget / MIN_RUN_BUF, (size_t)2);
+        while (runs.size() > fan_in) {
+            while (!runs.empty()) {
+                size_t n = std::min(fan_in, runs.size());
+                merging.assign(runs.begin(), runs.begin() + n);
+                runs.erase(runs.begin(), runs.begin() + n);
+                FILE* out = newRunFile();
+                if (!out) return fail();
+                nextRuns.push_back(out);
+                merger.open(merging, budget / (n + 1));
+                const uint8_t* key;
+                uint32_t len;
+                while (merger.next(key, len, error)) {
+                    if (!writeKey(out, key, len)) return fail();
+                }
+                if (error || fflush(out) != 0) return fail();
+                closeRuns(merging);
+            }
+            runs.swap(nextRuns);
+        }
+        merging.swap(runs);
+        merger.open(merging, budget / merging.size());
+        return true;
+    }
+
+    bool fail() {
+        error = true;
+        return false;
+    }
+
+    static void closeRuns(std::vector<FILE*>& files) {
+        for (FILE* fp : files) fclose(fp);
+        files.clear();
+    }
+
+    size_t               budget;
+    std::string          tmpDir;
+    uint8_t*             mem;         // the batch: keys, then entries
+    size_t               keyEnd;
+    Entry*               entryBegin;
+    Entry*               entryEnd;
+    bool                 finished;
+    bool                 error;
+    size_t               cursor;
+    std::vector<FILE*>   runs;
+    std::vector<FILE*>   merging;     // runs being merged
+    std::vector<FILE*>   nextRuns;    // output of an intermediate pass
+    Merger               merger;
+};
+
+}
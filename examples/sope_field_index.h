@@ -0,0 +1,88 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+#include "sope_record_def.h"
+
+#include <vector>
+
+namespace sope_test {
+
+/**
+ * Field offsets of one encoded record, built on demand.
+ *
+ * offset(i) is the position of the indicator of field i. The first
+ * call for a field skips the fields before it that are not indexed
+ * yet (fixed-width ones by their length, strings and binaries by a
+ * terminator scan), and records their offsets on the way; after that
+ * any field up to it is found in O(1).
+ *
+ *   FieldIndex idx(ps);
+ *   idx.reset(rec.getData());
+ *   if (!idx.isNull(7)) {
+ *       rec.setPos(idx.valueOffset(7));
+ *       long v = rec.getLong(ps->isAsc(7));
+ *   }
+ *
+ * The index belongs to the record given to reset(); reset() for the
+ * next record costs nothing, so one index serves a whole scan.
+ */
+class FieldIndex {
+public:
+    explicit FieldIndex(const RecordDef* ps)
+        : pSchema(ps)
+        , offsets(ps->getNumFields() + 1)
+        , pData(nullptr)
+        , built(0) {}
+
+    void reset(const void* pdata) {
+        pData = _RC(const uint8_t*, pdata);
+        offsets[0] = 0;
+        built = 1;
+    }
+
+    uint32_t offset(int i) {
+        for (; built <= i; built++) {
+            uint32_t off = offsets[built - 1];
+            const FieldDef& fd = pSchema->getFieldDef(built - 1);
+            offsets[built] = off + EncodedRecord::fieldLen(pData + off, fd.type,
+                                                           fd.asc, fd.enc);
+        }
+        return offsets[i];
+    }
+
+    bool isNull(int i) {
+        return pData[offset(i)] == (pSchema->isAsc(i) ? NULL_ASC : NULL_DESC);
+    }
+
+    // offset of the value of a non-NULL field
+    uint32_t valueOffset(int i) {
+        return offset(i) + LEN_NULL;
+    }
+
+    // end of the last field, i.e. the record length
+    uint32_t endOffset() {
+        return offset(pSchema->getNumFields());
+    }
+
+private:
+    const RecordDef*      pSchema;
+    std::vector<uint32_t> offsets;
+    const uint8_t*        pData;
+    int                   built;    // offsets[0, built) are known
+};
+
+}
@@ -0,0 +1,477 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+#include "sope_sort.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+namespace sope {
+
+/**
+ * Sorted key blocks: a compact format for a sorted set of encoded keys,
+ * as a byte buffer that can be kept in memory or written to a file.
+ *
+ *   block 0 | ... | block n-1 | index | footer
+ *
+ * Keys of one schema share long prefixes (a leading column, repeated
+ * strings), so each key is stored front-coded, as the number of bytes
+ * it shares with the previous key and the rest of it:
+ *
+ *   leb128 shared | leb128 unshared | unshared bytes
+ *
+ * Every restart_interval keys a key is stored whole (shared = 0), and
+ * the block ends with the offsets of these restart points:
+ *
+ *   entries | uint32 restart[0, r) | uint32 r
+ *
+ * A block is closed once it reaches block_size bytes. The index has one
+ * entry per block, with a separator key that is not below any key of
+ * the block and not above the first key of the next block: the
+ * shortest prefix of that first key which is above the last key (or
+ * the last key, when the two are equal). The last block gets its last
+ * key.
+ *
+ *   entries: leb128 sep_len | sep | leb128 offset | leb128 size
+ *   uint32 entry_offset[0, n)
+ *
+ * The footer is uint64 index offset | uint64 key count |
+ * uint32 block count | uint32 KEY_BLOCK_MAGIC. Fixed-width integers
+ * are big-endian; leb128 is the unsigned little-endian base-128 varint,
+ * 7 bits per byte, not the order-preserving varint of EncodedRecord.
+ *
+ * A seek is a binary search over the separators, then over the restart
+ * points of the block (their keys are whole), then a scan of at most
+ * restart_interval entries.
+ */
+const uint32_t KEY_BLOCK_MAGIC = 0x534B4231;    // "SKB1"
+const uint32_t KEY_BLOCK_FOOTER_LEN = 24;
+
+namespace key_block {
+
+inline void putLeb128(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+inline const uint8_t* getLeb128(const uint8_t* p, uint64_t& v) {
+    v = 0;
+    for (int shift = 0; ; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (b < 0x80) return p;
+    }
+}
+
+// as above, but null if the varint does not end before end
+inline const uint8_t* getLeb128(const uint8_t* p, const uint8_t* end,
+                                uint64_t& v) {
+    v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if (b < 0x80) return p;
+    }
+    return nullptr;
+}
+
+inline void putFixed32(std::vector<uint8_t>& out, uint32_t v) {
+    v = _enc32(v);
+    out.insert(out.end(), _RC(uint8_t*, &v), _RC(uint8_t*, &v) + sizeof(v));
+}
+
+inline void putFixed64(std::vector<uint8_t>& out, uint64_t v) {
+    v = _enc64(v);
+    out.insert(out.end(), _RC(uint8_t*, &v), _RC(uint8_t*, &v) + sizeof(v));
+}
+
+inline uint32_t getFixed32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return _dec32(v);
+}
+
+inline uint64_t getFixed64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return _dec64(v);
+}
+
+inline uint32_t sharedLen(const uint8_t* a, uint32_t a_len,
+                          const uint8_t* b, uint32_t b_len) {
+    uint32_t n = (a_len < b_len) ? a_len : b_len;
+    uint32_t i = 0;
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+}
+
+}
+
+/**
+ * Writes keys, given in order, as key blocks.
+ *
+ *   KeyBlockBuilder builder;
+ *   for (...) builder.add(key, len);
+ *   const std::vector<uint8_t>& data = builder.finish();
+ */
+class KeyBlockBuilder {
+public:
+    KeyBlockBuilder(uint32_t block_size = 4096, uint32_t restart_interval = 16)
+        : blockSize(block_size)
+        , restartInterval(restart_interval ? restart_interval : 1)
+        , numKeys(0)
+        , numBlocks(0)
+        , blockStart(0)
+        , blockKeys(0)
+        , pendingIndex(false)
+        , finished(false) {}
+
+    // key must not be less than the previous one
+    void add(const void* key, uint32_t len) {
+        const uint8_t* k = _RC(const uint8_t*, key);
+        if (pendingIndex) addIndexEntry(k, len);
+        uint32_t shared = 0;
+        if (blockKeys % restartInterval == 0) {
+            restarts.push_back(out.size() - blockStart);
+        } else {
+            shared = key_block::sharedLen(lastKey.data(), lastKey.size(), k, len);
+        }
+        key_block::putLeb128(out, shared);
+        key_block::putLeb128(out, len - shared);
+        out.insert(out.end(), k + shared, k + len);
+        lastKey.assign(k, k + len);
+        blockKeys++;
+        numKeys++;
+        if (out.size() - blockStart >= blockSize) closeBlock();
+    }
+
+    void add(const EncodedRecord* pr) {
+        add(pr->getData(), (uint32_t)pr->getEndPos());
+    }
+
+    // appends the index and the footer; no add() after this
+    const std::vector<uint8_t>& finish() {
+        if (finished) return out;
+        finished = true;
+        if (blockKeys > 0) closeBlock();
+        if (pendingIndex) addIndexEntry(nullptr, 0);
+        uint64_t index_offset = out.size();
+        out.insert(out.end(), index.begin(), index.end());
+        for (uint32_t off : indexOffsets) key_block::putFixed32(out, off);
+        key_block::putFixed64(out, index_offset);
+        key_block::putFixed64(out, numKeys);
+        key_block::putFixed32(out, numBlocks);
+        key_block::putFixed32(out, KEY_BLOCK_MAGIC);
+        return out;
+    }
+
+    // writes the finished data to fp
+    bool writeTo(FILE* fp) {
+        const std::vector<uint8_t>& data = finish();
+        return fwrite(data.data(), 1, data.size(), fp) == data.size();
+    }
+
+    uint64_t getNumKeys() const { return numKeys; }
+
+private:
+    void closeBlock() {
+        for (uint32_t off : restarts) key_block::putFixed32(out, off);
+        key_block::putFixed32(out, restarts.size());
+        restarts.clear();
+        pendingOffset = blockStart;
+        pendingSize = out.size() - blockStart;
+        pendingIndex = true;
+        numBlocks++;
+        blockStart = out.size();
+        blockKeys = 0;
+    }
+
+    // index entry of the last closed block, next is the first key of
+    // the following block (null for the last block)
+    void addIndexEntry(const uint8_t* next, uint32_t next_len) {
+        const uint8_t* sep = lastKey.data();
+        uint32_t sep_len = lastKey.size();
+        if (next) {
+            sep = next;
+            sep_len = key_block::sharedLen(lastKey.data(), lastKey.size(),
+                                           next, next_len);
+            if (sep_len < next_len) sep_len++;
+        }
+        indexOffsets.push_back(index.size());
+        key_block::putLeb128(index, sep_len);
+        index.insert(index.end(), sep, sep + sep_len);
+        key_block::putLeb128(index, pendingOffset);
+        key_block::putLeb128(index, pendingSize);
+        pendingIndex = false;
+    }
+
+    uint32_t              blockSize;
+    uint32_t              restartInterval;
+    std::vector<uint8_t>  out;
+    std::vector<uint8_t>  lastKey;
+    std::vector<uint32_t> restarts;     // of the current block
+    std::vector<uint8_t>  index;
+    std::vector<uint32_t> indexOffsets;
+    uint64_t              numKeys;
+    uint32_t              numBlocks;
+    size_t                blockStart;
+    uint32_t              blockKeys;
+    bool                  pendingIndex; // a closed block without index entry
+    uint64_t              pendingOffset;
+    uint64_t              pendingSize;
+    bool                  finished;
+};
+
+/**
+ * Reads key blocks in place: the data is not copied and must stay
+ * valid while the reader and its iterators are used.
+ *
+ *   KeyBlockReader reader;
+ *   if (!reader.open(data, len)) ...;
+ *   KeyBlockReader::Iterator it(&reader);
+ *   for (it.seek(low); it.valid() && compareKeys(it.key(), high) < 0; it.next())
+ *       ...
+ */
+class KeyBlockReader {
+public:
+    KeyBlockReader()
+        : pData(nullptr)
+        , dataLen(0)
+        , pIndex(nullptr)
+        , pIndexOffsets(nullptr)
+        , numKeys(0)
+        , numBlocks(0) {}
+
+    // false if data does not end with a valid footer, or if an index
+    // entry, a block or its restart points do not fit in the data
+    bool open(const void* data, size_t len) {
+        pData = _RC(const uint8_t*, data);
+        dataLen = len;
+        if (len < KEY_BLOCK_FOOTER_LEN) return false;
+        const uint8_t* footer = pData + len - KEY_BLOCK_FOOTER_LEN;
+        if (key_block::getFixed32(footer + 20) != KEY_BLOCK_MAGIC) return false;
+        uint64_t index_offset = key_block::getFixed64(footer);
+        numKeys = key_block::getFixed64(footer + 8);
+        numBlocks = key_block::getFixed32(footer + 16);
+        uint64_t offsets_at = len - KEY_BLOCK_FOOTER_LEN
+                              - (uint64_t)numBlocks * sizeof(uint32_t);
+        if (offsets_at > len || index_offset > offsets_at) return false;
+        pIndex = pData + index_offset;
+        pIndexOffsets = pData + offsets_at;
+        for (uint32_t b = 0; b < numBlocks; b++) {
+            if (!checkBlock(b)) return false;
+        }
+        return true;
+    }
+
+    uint64_t getNumKeys() const { return numKeys; }
+    uint32_t getNumBlocks() const { return numBlocks; }
+
+    class Iterator {
+    public:
+        explicit Iterator(const KeyBlockReader* r)
+            : reader(r)
+            , block(0)
+            , pBlock(nullptr)
+            , pos(nullptr)
+            , pEnd(nullptr)
+            , pRestarts(nullptr)
+            , numRestarts(0)
+            , isValid(false) {}
+
+        void seekToFirst() {
+            if (!loadBlock(0)) return;
+            readEntry();
+        }
+
+        // first key not less than key
+        void seek(KeyRef key) {
+            uint32_t b = reader->findBlock(key);
+            if (!loadBlock(b)) return;
+            // last restart point below key
+            uint32_t lo = 0;
+            uint32_t n = numRestarts;
+            while (n > 1) {
+                uint32_t half = n / 2;
+                if (compareKeys(restartKey(lo + half), key) < 0) {
+                    lo += half;
+                    n -= half;
+                } else {
+                    n = half;
+                }
+            }
+            pos = pBlock + restartOffset(lo);
+            curKey.clear();
+            readEntry();
+            while (isValid && compareKeys(this->key(), key) < 0) next();
+        }
+
+        bool valid() const { return isValid; }
+
+        void next() {
+            if (pos < pEnd) {
+                readEntry();
+            } else if (loadBlock(block + 1)) {
+                readEntry();
+            }
+        }
+
+        // valid until the next move
+        KeyRef key() const {
+            return KeyRef{curKey.data(), (uint32_t)curKey.size()};
+        }
+
+    private:
+        bool loadBlock(uint32_t b) {
+            isValid = false;
+            if (b >= reader->numBlocks) return false;
+            uint64_t offset, size;
+            reader->blockHandle(b, offset, size);
+            block = b;
+            pBlock = reader->pData + offset;
+            numRestarts = key_block::getFixed32(pBlock + size - sizeof(uint32_t));
+            pRestarts = pBlock + size - (1 + numRestarts) * sizeof(uint32_t);
+            pEnd = pRestarts;
+            pos = pBlock;
+            curKey.clear();
+            return true;
+        }
+
+        // a corrupt entry ends the iteration
+        void readEntry() {
+            uint64_t shared, unshared = 0;
+            pos = key_block::getLeb128(pos, pEnd, shared);
+            if (pos) pos = key_block::getLeb128(pos, pEnd, unshared);
+            if (!pos || shared > curKey.size() ||
+                unshared > (uint64_t)(pEnd - pos)) {
+                pos = pEnd;
+                isValid = false;
+                return;
+            }
+            curKey.resize(shared);
+            curKey.insert(curKey.end(), pos, pos + unshared);
+            pos += unshared;
+            isValid = true;
+        }
+
+        uint32_t restartOffset(uint32_t i) const {
+            return key_block::getFixed32(pRestarts + i * sizeof(uint32_t));
+        }
+
+        // restart keys are stored whole
+        KeyRef restartKey(uint32_t i) const {
+            uint64_t shared, unshared;
+            const uint8_t* p = pBlock + restartOffset(i);
+            p = key_block::getLeb128(p, shared);
+            p = key_block::getLeb128(p, unshared);
+            return KeyRef{p, (uint32_t)unshared};
+        }
+
+        const KeyBlockReader* reader;
+        uint32_t              block;
+        const uint8_t*        pBlock;
+        const uint8_t*        pos;          // next entry
+        const uint8_t*        pEnd;         // end of the entries
+        const uint8_t*        pRestarts;
+        uint32_t              numRestarts;
+        std::vector<uint8_t>  curKey;
+        bool                  isValid;
+    };
+
+private:
+    const uint8_t* indexEntry(uint32_t b, KeyRef& sep) const {
+        uint64_t len;
+        const uint8_t* p = pIndex + key_block::getFixed32(
+                                        pIndexOffsets + b * sizeof(uint32_t));
+        p = key_block::getLeb128(p, len);
+        sep = KeyRef{p, (uint32_t)len};
+        return p + len;
+    }
+
+    void blockHandle(uint32_t b, uint64_t& offset, uint64_t& size) const {
+        KeyRef sep;
+        const uint8_t* p = indexEntry(b, sep);
+        p = key_block::getLeb128(p, offset);
+        key_block::getLeb128(p, size);
+    }
+
+    // The index entry of block b lies within the index, the block
+    // within the data before it, and the block has at least one
+    // restart point, each at a whole key inside the entries.
+    bool checkBlock(uint32_t b) const {
+        const uint8_t* end = pIndexOffsets;
+        uint32_t at = key_block::getFixed32(pIndexOffsets + b * sizeof(uint32_t));
+        if (at >= (uint64_t)(end - pIndex)) return false;
+        uint64_t sep_len, offset, size;
+        const uint8_t* p = key_block::getLeb128(pIndex + at, end, sep_len);
+        if (!p || sep_len > (uint64_t)(end - p)) return false;
+        p = key_block::getLeb128(p + sep_len, end, offset);
+        if (p) p = key_block::getLeb128(p, end, size);
+        uint64_t index_offset = pIndex - pData;
+        if (!p || offset > index_offset || size > index_offset - offset ||
+            size < 2 * sizeof(uint32_t)) {
+            return false;
+        }
+        const uint8_t* block = pData + offset;
+        uint32_t n = key_block::getFixed32(block + size - sizeof(uint32_t));
+        if (n == 0 || n > size / sizeof(uint32_t) - 1) return false;
+        const uint8_t* restarts = block + size - (1 + (uint64_t)n) * sizeof(uint32_t);
+        for (uint32_t i = 0; i < n; i++) {
+            uint32_t off = key_block::getFixed32(restarts + i * sizeof(uint32_t));
+            if (off >= (uint64_t)(restarts - block)) return false;
+            uint64_t shared, unshared;
+            p = key_block::getLeb128(block + off, restarts, shared);
+            if (p) p = key_block::getLeb128(p, restarts, unshared);
+            if (!p || shared != 0 || unshared > (uint64_t)(restarts - p)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the block holding the first key not less than key, if any: the
+    // first block whose separator is not below key, or the last one
+    uint32_t findBlock(KeyRef key) const {
+        uint32_t lo = 0;
+        uint32_t n = (numBlocks > 0) ? numBlocks - 1 : 0;
+        while (n > 0) {
+            uint32_t half = n / 2;
+            KeyRef sep;
+            indexEntry(lo + half, sep);
+            if (compareKeys(sep, key) < 0) {
+                lo += half + 1;
+                n -= half + 1;
+            } else {
+                n = half;
+            }
+        }
+        return lo;
+    }
+
+    const uint8_t* pData;
+    size_t         dataLen;
+    const uint8_t* pIndex;
+    const uint8_t* pIndexOffsets;
+    uint64_t       numKeys;
+    uint32_t       numBlocks;
+};
+
+}
@@ -0,0 +1,313 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+namespace sope {
+
+/**
+ * Compile-time typed key codec (C++17).
+ *
+ * When the schema is known at compile time, it can be spelled as
+ *
+ *   typedef KeyCodec< Field<int32_t, Asc>,
+ *                     Field<std::string_view, Desc>,
+ *                     Nullable<Field<double, Asc>> > MyKey;
+ *
+ *   MyKey::Tuple t(10, "This is a string", 1234.5678);
+ *   size_t len = MyKey::encode(t, buf);
+ *   MyKey::decode(buf, t, scratch);
+ *
+ * Field<> values are written back to back, as in sope_simple_test.cc.
+ * Nullable<> adds the same NULL / not-NULL indicator byte that
+ * EncodedRecord writes, so a KeyCodec with every field Nullable
+ * produces the same bytes as the record example.
+ *
+ * Order and type are template parameters, so encode/decode have no
+ * asc branches and no per-field type dispatch. Leading fixed-width
+ * fields sit at constexpr offsets (offset<I>(), fixedPrefixLen), and
+ * can be read directly with get<I>() without decoding the others.
+ *
+ * Decoded strings are std::string_view. Ascending strings point into
+ * the encoded key; descending ones are un-flipped into the scratch
+ * buffer given to decode(), which needs at most encoded-length bytes.
+ * decode() without a scratch buffer only compiles for keys without
+ * descending strings (needsScratch is false).
+ */
+
+struct Asc  { static constexpr bool asc = true; };
+struct Desc { static constexpr bool asc = false; };
+
+// Per-type encoding; width is 0 for variable-length types.
+template <typename T> struct FieldTraits;
+
+template <> struct FieldTraits<int32_t> {
+    static constexpr size_t width = LEN_INT;
+    template <bool asc>
+    static void put(int32_t v, uint8_t* p) {
+        uint32_t e = encode((int)v, asc);
+        memcpy(p, &e, sizeof(e));
+    }
+    template <bool asc>
+    static int32_t get(const uint8_t* p) { return decode_int(p, asc); }
+};
+
+template <> struct FieldTraits<int64_t> {
+    static constexpr size_t width = LEN_LONG;
+    template <bool asc>
+    static void put(int64_t v, uint8_t* p) {
+        uint64_t e = encode((long)v, asc);
+        memcpy(p, &e, sizeof(e));
+    }
+    template <bool asc>
+    static int64_t get(const uint8_t* p) { return decode_long(p, asc); }
+};
+
+// Timestamp
+template <> struct FieldTraits<uint64_t> {
+    static constexpr size_t width = LEN_TIMESTAMP;
+    template <bool asc>
+    static void put(uint64_t v, uint8_t* p) {
+        uint64_t e = encode((Timestamp)v, asc);
+        memcpy(p, &e, sizeof(e));
+    }
+    template <bool asc>
+    static uint64_t get(const uint8_t* p) { return decode_timestamp(p, asc); }
+};
+
+template <> struct FieldTraits<double> {
+    static constexpr size_t width = LEN_DOUBLE;
+    template <bool asc>
+    static void put(double v, uint8_t* p) {
+        uint64_t e = encode(v, asc);
+        memcpy(p, &e, sizeof(e));
+    }
+    template <bool asc>
+    static double get(const uint8_t* p) { return decode_double(p, asc); }
+};
+
+// Same byte as EncodedRecord::put(bool)
+template <> struct FieldTraits<bool> {
+    static constexpr size_t width = LEN_BOOL;
+    template <bool asc>
+    static void put(bool v, uint8_t* p) { *p = asc ? v : !v; }
+    template <bool asc>
+    static bool get(const uint8_t* p) { return asc ? *p != 0 : *p == 0; }
+};
+
+template <> struct FieldTraits<std::string_view> {
+    static constexpr size_t width = 0;
+};
+
+template <typename T, typename Order = Asc>
+struct Field {
+    typedef T value_type;
+    static constexpr bool asc = Order::asc;
+    static constexpr size_t width = FieldTraits<T>::width;
+    static constexpr bool bounded = true;
+    static constexpr bool needsScratch = false;
+    static constexpr size_t maxSize = width;
+
+    static size_t size(const T&) { return width; }
+    static size_t encode(const T& v, uint8_t* p) {
+        FieldTraits<T>::template put<asc>(v, p);
+        return width;
+    }
+    static size_t decode(const uint8_t* p, T& v, uint8_t*&) {
+        v = FieldTraits<T>::template get<asc>(p);
+        return width;
+    }
+};
+
+template <typename Order>
+struct Field<std::string_view, Order> {
+    typedef std::string_view value_type;
+    static constexpr bool asc = Order::asc;
+    static constexpr size_t width = 0;
+    static constexpr bool bounded = false;
+    static constexpr bool needsScratch = !asc;
+    static constexpr size_t maxSize = 0;
+
+    static size_t size(const std::string_view& v) {
+        return calc_string_encoded_len(v.size());
+    }
+    static size_t encode(const std::string_view& v, uint8_t* p) {
+        return sope::encode(v.data(), (uint32_t)v.size(), p, asc);
+    }
+    static size_t decode(const uint8_t* p, std::string_view& v,
+                         uint8_t*& scratch) {
+        uint32_t len;
+        if constexpr (asc) {
+            len = get_string_len(p, true);
+            v = std::string_view(_RC(const char*, p), len);
+        } else {
+            len = decode_string(p, scratch, false);
+            v = std::string_view(_RC(const char*, scratch), len);
+            scratch += len;
+        }
+        return len + STRING_PAD_LEN;
+    }
+};
+
+template <typename F>
+struct Nullable {
+    typedef std::optional<typename F::value_type> value_type;
+    static constexpr bool asc = F::asc;
+    static constexpr size_t width = 0;
+    static constexpr bool bounded = F::bounded;
+    static constexpr bool needsScratch = F::needsScratch;
+    static constexpr size_t maxSize = LEN_NULL + F::maxSize;
+
+    static size_t size(const value_type& v) {
+        return LEN_NULL + (v ? F::size(*v) : 0);
+    }
+    static size_t encode(const value_type& v, uint8_t* p) {
+        if (!v) {
+            *p = asc ? NULL_ASC : NULL_DESC;
+            return LEN_NULL;
+        }
+        *p = asc ? NOT_NULL_ASC : NOT_NULL_DESC;
+        return LEN_NULL + F::encode(*v, p + LEN_NULL);
+    }
+    static size_t decode(const uint8_t* p, value_type& v, uint8_t*& scratch) {
+        if (*p == (asc ? NULL_ASC : NULL_DESC)) {
+            v.reset();
+            return LEN_NULL;
+        }
+        typename F::value_type inner;
+        size_t len = F::decode(p + LEN_NULL, inner, scratch);
+        v = inner;
+        return LEN_NULL + len;
+    }
+};
+
+template <typename... Fields>
+class KeyCodec {
+public:
+    typedef std::tuple<typename Fields::value_type...> Tuple;
+
+    static constexpr size_t numFields = sizeof...(Fields);
+
+private:
+    static constexpr size_t widths[] = { Fields::width... };
+
+    static constexpr size_t countFixedPrefix() {
+        size_t n = 0;
+        while (n < numFields && widths[n] != 0) n++;
+        return n;
+    }
+
+public:
+    // number of leading fixed-width fields, and their total length
+    static constexpr size_t fixedPrefixCount = countFixedPrefix();
+
+    template <size_t I>
+    static constexpr size_t offset() {
+        static_assert(I <= fixedPrefixCount,
+                      "offset is only constant within the fixed-width prefix");
+        size_t off = 0;
+        for (size_t i = 0; i < I; i++) off += widths[i];
+        return off;
+    }
+
+    static constexpr size_t fixedPrefixLen = offset<fixedPrefixCount>();
+
+    // true if no field is variable-length
+    static constexpr bool bounded = (Fields::bounded && ...);
+
+    // true if decode() needs a scratch buffer (descending strings)
+    static constexpr bool needsScratch = (Fields::needsScratch || ...);
+
+    static constexpr size_t maxSize() {
+        static_assert(bounded, "key has variable-length fields");
+        return (Fields::maxSize + ...);
+    }
+
+    static size_t encodedSize(const Tuple& t) {
+        return sizeImpl(t, std::index_sequence_for<Fields...>());
+    }
+
+    // returns the encoded length
+    static size_t encode(const Tuple& t, void* buf) {
+        return encodeImpl(t, _RC(uint8_t*, buf),
+                          std::index_sequence_for<Fields...>());
+    }
+
+    // returns the bytes consumed
+    static size_t decode(const void* buf, Tuple& t, void* scratch) {
+        uint8_t* ps = _SCU(scratch);
+        return decodeImpl(_RC(const uint8_t*, buf), t, ps,
+                          std::index_sequence_for<Fields...>());
+    }
+
+    static size_t decode(const void* buf, Tuple& t) {
+        static_assert(!needsScratch,
+                      "descending string fields decode into a scratch buffer");
+        uint8_t* ps = nullptr;
+        return decodeImpl(_RC(const uint8_t*, buf), t, ps,
+                          std::index_sequence_for<Fields...>());
+    }
+
+    // direct read of a field within the fixed-width prefix
+    template <size_t I>
+    static typename std::tuple_element<I, Tuple>::type get(const void* buf) {
+        static_assert(I < fixedPrefixCount,
+                      "only fixed-width prefix fields can be read directly");
+        typename std::tuple_element<I, Tuple>::type v;
+        uint8_t* unused = nullptr;
+        std::tuple_element_t<I, std::tuple<Fields...>>::decode(
+                _RC(const uint8_t*, buf) + offset<I>(), v, unused);
+        return v;
+    }
+
+private:
+    template <size_t... I>
+    static size_t sizeImpl(const Tuple& t, std::index_sequence<I...>) {
+        return (Fields::size(std::get<I>(t)) + ...);
+    }
+
+    template <size_t I>
+    static size_t fieldPos(size_t pos) {
+        if constexpr (I < fixedPrefixCount) return offset<I>();
+        else return pos;
+    }
+
+    template <size_t... I>
+    static size_t encodeImpl(const Tuple& t, uint8_t* p,
+                             std::index_sequence<I...>) {
+        size_t pos = 0;
+        ((pos = fieldPos<I>(pos),
+          pos += Fields::encode(std::get<I>(t), p + pos)), ...);
+        return pos;
+    }
+
+    template <size_t... I>
+    static size_t decodeImpl(const uint8_t* p, Tuple& t, uint8_t*& scratch,
+                             std::index_sequence<I...>) {
+        size_t pos = 0;
+        ((pos = fieldPos<I>(pos),
+          pos += Fields::decode(p + pos, std::get<I>(t), scratch)), ...);
+        return pos;
+    }
+};
+
+}
@@ -0,0 +1,321 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+#include "sope_record_def.h"
+#include "sope_sort.h"
+#include "sope_table.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace sope_test {
+
+/**
+ * Persisted key index: the sorted encoded keys of a table in a file
+ * that is used through mmap as it is, without loading or decoding.
+ *
+ *   header | field[0, f) | uint64 offset[0, n] | keys
+ *
+ * header (40 bytes):
+ *   char[8] KEY_INDEX_MAGIC | uint32 version | uint32 field count f |
+ *   uint64 key count n | uint64 position of offset[] |
+ *   uint64 position of the keys
+ * field (4 bytes): uint8 Type | uint8 asc | uint8 Encoding |
+ *   uint8 reserved (0)
+ *
+ * Key i is keys[offset[i], offset[i + 1]). Integers are big-endian and
+ * read as needed, so opening the file is a few reads of the header:
+ * startup does not depend on the number of keys, and lookups touch
+ * only the pages they need.
+ *
+ *   writeKeyIndex(table, "/data/keys.idx");        // table sorted
+ *   KeyIndex idx;
+ *   if (idx.open("/data/keys.idx") && idx.sameSchema(ps)) {
+ *       for (uint64_t i = idx.lowerBound(cond.getLow());
+ *            i < idx.getNumKeys() &&
+ *            compareKeys(idx.getKey(i), cond.getHigh()) < 0; i++) ...
+ *   }
+ */
+const char KEY_INDEX_MAGIC[8] = {'S', 'O', 'P', 'E', 'K', 'I', 'D', 'X'};
+const uint32_t KEY_INDEX_VERSION = 1;
+const uint32_t KEY_INDEX_HEADER_LEN = 40;
+const uint32_t KEY_INDEX_FIELD_LEN = 4;
+
+namespace key_index {
+
+inline void putFixed32(uint8_t* p, uint32_t v) {
+    v = _enc32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+inline void putFixed64(uint8_t* p, uint64_t v) {
+    v = _enc64(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+inline uint32_t getFixed32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return _dec32(v);
+}
+
+inline uint64_t getFixed64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return _dec64(v);
+}
+
+// fsyncs the directory holding path, so that a rename into it is durable
+inline bool syncParentDir(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "."
+                    : (slash == 0) ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return false;
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+}
+
+/**
+ * Writes the records of a sorted table as a key index. The file is
+ * written to a unique temporary file next to path and renamed into
+ * place, and the directory is synced, so a reader never sees a partial
+ * index and concurrent writers do not clobber each other's temporary
+ * files. Returns false on I/O errors, or if the table is not sorted.
+ */
+inline bool writeKeyIndex(const Table& t, const std::string& path) {
+    const RecordDef* ps = t.getSchema();
+    uint64_t n = t.getNumRecords();
+    uint32_t n_fields = ps->getNumFields();
+    uint64_t offsets_at = KEY_INDEX_HEADER_LEN + n_fields * KEY_INDEX_FIELD_LEN;
+    offsets_at = (offsets_at + 7) & ~(uint64_t)7;
+    uint64_t keys_at = offsets_at + (n + 1) * sizeof(uint64_t);
+
+    std::vector<uint8_t> head(offsets_at, 0);
+    memcpy(&head[0], KEY_INDEX_MAGIC, sizeof(KEY_INDEX_MAGIC));
+    key_index::putFixed32(&head[8], KEY_INDEX_VERSION);
+    key_index::putFixed32(&head[12], n_fields);
+    key_index::putFixed64(&head[16], n);
+    key_index::putFixed64(&head[24], offsets_at);
+    key_index::putFixed64(&head[32], keys_at);
+    for (uint32_t i = 0; i < n_fields; i++) {
+        uint8_t* f = &head[KEY_INDEX_HEADER_LEN + i * KEY_INDEX_FIELD_LEN];
+        f[0] = (uint8_t)ps->getType(i);
+        f[1] = ps->isAsc(i) ? 1 : 0;
+        f[2] = (uint8_t)ps->getEncoding(i);
+    }
+
+    std::vector<uint8_t> offsets((n + 1) * sizeof(uint64_t));
+    uint64_t off = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        if (i > 0 && compareKeys(t.getArena().getKey(t.getHandle(i - 1)),
+                                 t.getArena().getKey(t.getHandle(i))) > 0) {
+            return false;
+        }
+        key_index::putFixed64(&offsets[i * sizeof(uint64_t)], off);
+        off += t.getLen(i);
+    }
+    key_index::putFixed64(&offsets[n * sizeof(uint64_t)], off);
+
+    std::string tmp_path = path + ".XXXXXX";
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd < 0) return false;
+    // mkstemp creates the file 0600
+    FILE* fp = (fchmod(fd, 0644) == 0) ? fdopen(fd, "wb") : nullptr;
+    if (!fp) {
+        ::close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    bool ok = fwrite(head.data(), 1, head.size(), fp) == head.size() &&
+              fwrite(offsets.data(), 1, offsets.size(), fp) == offsets.size();
+    for (uint64_t i = 0; ok && i < n; i++) {
+        ok = fwrite(t.getData(i), 1, t.getLen(i), fp) == t.getLen(i);
+    }
+    ok = (fflush(fp) == 0) && ok;
+    ok = (fsync(fileno(fp)) == 0) && ok;
+    ok = (fclose(fp) == 0) && ok;
+    if (ok) ok = rename(tmp_path.c_str(), path.c_str()) == 0;
+    if (!ok) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return key_index::syncParentDir(path);
+}
+
+/**
+ * Read-only view of a key index file, mapped into memory.
+ */
+class KeyIndex {
+public:
+    KeyIndex()
+        : pSchema(nullptr)
+        , pMap(nullptr)
+        , mapLen(0)
+        , pOffsets(nullptr)
+        , pKeys(nullptr)
+        , keysLen(0)
+        , numKeys(0) {}
+
+    ~KeyIndex() { close(); }
+
+    KeyIndex(const KeyIndex&) = delete;
+    KeyIndex& operator=(const KeyIndex&) = delete;
+
+    // False if the file cannot be mapped or is not a key index. Only
+    // the header and the end of the offsets are checked, not each key:
+    // getKey() checks the offsets of the key it reads.
+    bool open(const std::string& path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < (off_t)KEY_INDEX_HEADER_LEN) {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        pMap = _RC(const uint8_t*, p);
+        mapLen = st.st_size;
+        if (!readHeader()) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (pMap) munmap(const_cast<uint8_t*>(pMap), mapLen);
+        delete pSchema;
+        pSchema = nullptr;
+        pMap = nullptr;
+        mapLen = 0;
+        pOffsets = nullptr;
+        pKeys = nullptr;
+        keysLen = 0;
+        numKeys = 0;
+    }
+
+    // schema stored in the header
+    const RecordDef* getSchema() const { return pSchema; }
+
+    // true if ps has the types, orders and encodings of the stored
+    // schema; false if no index is open
+    bool sameSchema(const RecordDef* ps) const {
+        if (!pSchema) return false;
+        if (ps->getNumFields() != pSchema->getNumFields()) return false;
+        for (int i = 0; i < ps->getNumFields(); i++) {
+            if (ps->getType(i) != pSchema->getType(i) ||
+                ps->isAsc(i) != pSchema->isAsc(i) ||
+                ps->getEncoding(i) != pSchema->getEncoding(i)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    uint64_t getNumKeys() const { return numKeys; }
+
+    // an empty key if the offsets of key i are out of order or bounds
+    KeyRef getKey(uint64_t i) const {
+        uint64_t off = key_index::getFixed64(pOffsets + i * sizeof(uint64_t));
+        uint64_t end = key_index::getFixed64(pOffsets + (i + 1) * sizeof(uint64_t));
+        if (off > end || end > keysLen) return KeyRef{pKeys, 0};
+        return KeyRef{pKeys + off, (uint32_t)(end - off)};
+    }
+
+    // first key, from `first` on, not less than key
+    uint64_t lowerBound(KeyRef key, uint64_t first = 0) const {
+        uint64_t n = numKeys - first;
+        while (n > 0) {
+            uint64_t half = n / 2;
+            if (compareKeys(getKey(first + half), key) < 0) {
+                first += half + 1;
+                n -= half + 1;
+            } else {
+                n = half;
+            }
+        }
+        return first;
+    }
+
+private:
+    const uint8_t* fieldAt(uint32_t i) const {
+        return pMap + KEY_INDEX_HEADER_LEN + i * KEY_INDEX_FIELD_LEN;
+    }
+
+    bool readHeader() {
+        if (memcmp(pMap, KEY_INDEX_MAGIC, sizeof(KEY_INDEX_MAGIC)) != 0 ||
+            key_index::getFixed32(pMap + 8) != KEY_INDEX_VERSION) {
+            return false;
+        }
+        uint32_t n_fields = key_index::getFixed32(pMap + 12);
+        numKeys = key_index::getFixed64(pMap + 16);
+        uint64_t offsets_at = key_index::getFixed64(pMap + 24);
+        uint64_t keys_at = key_index::getFixed64(pMap + 32);
+        if (offsets_at < KEY_INDEX_HEADER_LEN + (uint64_t)n_fields * KEY_INDEX_FIELD_LEN ||
+            offsets_at > keys_at || keys_at > mapLen) {
+            return false;
+        }
+        // offset[] has numKeys + 1 entries, and ends where the keys start
+        uint64_t slots = (keys_at - offsets_at) / sizeof(uint64_t);
+        if (slots == 0 || numKeys != slots - 1 ||
+            offsets_at + slots * sizeof(uint64_t) != keys_at) {
+            return false;
+        }
+        pOffsets = pMap + offsets_at;
+        pKeys = pMap + keys_at;
+        keysLen = mapLen - keys_at;
+        if (key_index::getFixed64(pOffsets + numKeys * sizeof(uint64_t)) >
+            keysLen) {
+            return false;
+        }
+        for (uint32_t i = 0; i < n_fields; i++) {
+            const uint8_t* f = fieldAt(i);
+            if (f[0] > TYPE_OBJECT || f[2] > ENCODING_VARINT) return false;
+            if (!RecordDef::isValidEncoding((Type)f[0], (Encoding)f[2])) {
+                return false;
+            }
+        }
+        pSchema = new RecordDef(n_fields);
+        for (uint32_t i = 0; i < n_fields; i++) {
+            pSchema->setFieldDef(i, (Type)fieldAt(i)[0], fieldAt(i)[1] != 0,
+                                 (Encoding)fieldAt(i)[2]);
+        }
+        return true;
+    }
+
+    RecordDef*     pSchema;
+    const uint8_t* pMap;
+    size_t         mapLen;
+    const uint8_t* pOffsets;
+    const uint8_t* pKeys;
+    uint64_t       keysLen;
+    uint64_t       numKeys;
+};
+
+}
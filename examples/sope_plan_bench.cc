@@ -0,0 +1,242 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#include "sope_record_plan.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace sope;
+using namespace sope_test;
+
+/************************************************
+Compares encoding and decoding rows through a
+RecordPlan against the field-by-field loop with
+a switch on RecordDef::getType, as in display()
+of sope_record_test.cc.
+
+usage: sope_plan_bench [number of rows] [rounds]
+**************************************************/
+
+namespace {
+
+// display()-style encode: switch on the type of every field
+uint32_t switchEncode(const RecordDef* ps, const FieldValue* row,
+                      EncodedRecord* pr) {
+    pr->resetPos();
+    for (int i = 0; i < ps->getNumFields(); i++) {
+        bool asc = ps->isAsc(i);
+        const FieldValue& v = row[i];
+        if (v.isNull) {
+            pr->putNullFieldIndicator(asc);
+            continue;
+        }
+        pr->putNotNullFieldIndicator(asc);
+        switch (ps->getType(i)) {
+        case TYPE_INT:       pr->put(v.i, asc); break;
+        case TYPE_LONG:
+        case TYPE_DATE:      pr->put(v.l, asc); break;
+        case TYPE_DOUBLE:    pr->put(v.d, asc); break;
+        case TYPE_BOOL:      pr->put(v.b, asc); break;
+        case TYPE_TIMESTAMP: pr->put(v.ts, asc); break;
+        case TYPE_STRING:    pr->put(_SCCC(v.ptr), v.len, asc); break;
+        case TYPE_BINARY:
+        case TYPE_OBJECT:    pr->put(v.ptr, v.len, asc); break;
+        case TYPE_NULL:      break;
+        }
+    }
+    return pr->getPos();
+}
+
+// display()-style decode into FieldValues
+void switchDecode(const RecordDef* ps, EncodedRecord* pr, FieldValue* row) {
+    pr->resetPos();
+    for (int i = 0; i < ps->getNumFields(); i++) {
+        bool asc = ps->isAsc(i);
+        FieldValue& v = row[i];
+        v.isNull = pr->checkNullFieldIndicator(asc);
+        if (v.isNull) continue;
+        switch (ps->getType(i)) {
+        case TYPE_INT:       v.i = pr->getInt(asc); break;
+        case TYPE_LONG:      v.l = pr->getLong(asc); break;
+        case TYPE_DOUBLE:    v.d = pr->getDouble(asc); break;
+        case TYPE_STRING:    v.ptr = pr->getString(v.len, asc); break;
+        case TYPE_BOOL:      v.b = pr->getBool(asc); break;
+        case TYPE_DATE:      v.l = pr->getDate(asc); break;
+        case TYPE_TIMESTAMP: v.ts = pr->getTimestamp(asc); break;
+        case TYPE_BINARY:
+        case TYPE_OBJECT:    v.ptr = pr->getBinary(v.len, asc); break;
+        case TYPE_NULL:      break;
+        }
+    }
+}
+
+// NULL count and variable-length bytes, the same for both decoders
+uint64_t checksum(const FieldValue* row, int n_fields) {
+    uint64_t sum = 0;
+    for (int i = 0; i < n_fields; i++) {
+        sum += row[i].isNull ? 1000000 : row[i].len;
+    }
+    return sum;
+}
+
+typedef std::chrono::steady_clock Clock;
+
+double nsPerRow(Clock::time_point start, size_t rows) {
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count()
+           / rows;
+}
+
+// n_rows rows are encoded and decoded `rounds` times
+void runSchema(const char* name, RecordDef* ps, size_t n_rows, int rounds) {
+    const int n_fields = ps->getNumFields();
+    const uint32_t ROW_BUF = 256;
+    const size_t n_total = n_rows * rounds;
+
+    // rows in native form, about 1 in 16 fields NULL
+    std::vector<FieldValue> rows(n_rows * n_fields);
+    std::vector<std::string> strs(64);
+    for (size_t k = 0; k < strs.size(); k++) {
+        strs[k] = std::string("This is a string ") + std::to_string(k * 7919);
+        if (k % 3 == 0) strs[k][5] = '\0';  // some binaries carry zeros
+    }
+    srand(1);
+    for (size_t r = 0; r < n_rows; r++) {
+        for (int i = 0; i < n_fields; i++) {
+            FieldValue& v = rows[r * n_fields + i];
+            v.isNull = (rand() % 16 == 0);
+            v.l = ((long)rand() << 20) - ((long)rand() << 8);
+            switch (ps->getType(i)) {
+            case TYPE_INT:    v.i = rand() - RAND_MAX / 2; break;
+            case TYPE_DOUBLE: v.d = (rand() - RAND_MAX / 2) / 7.0; break;
+            case TYPE_BOOL:   v.b = rand() & 1; break;
+            case TYPE_STRING:
+            case TYPE_BINARY:
+            case TYPE_OBJECT: {
+                const std::string& s = strs[rand() % strs.size()];
+                v.ptr = s.data();
+                v.len = s.size();
+                break; }
+            default: break;
+            }
+        }
+    }
+
+    std::vector<uint8_t> enc(n_rows * ROW_BUF);
+    std::vector<uint32_t> lens(n_rows);
+    RecordPlan plan(ps);
+
+    // one untimed pass each, also to check that the bytes match
+    std::vector<uint8_t> enc2(n_rows * ROW_BUF);
+    for (size_t r = 0; r < n_rows; r++) {
+        EncodedRecord rec(&enc2[r * ROW_BUF], ROW_BUF);
+        switchEncode(ps, &rows[r * n_fields], &rec);
+        lens[r] = plan.encode(&rows[r * n_fields], &enc[r * ROW_BUF]);
+    }
+    if (memcmp(enc.data(), enc2.data(), enc.size()) != 0) {
+        printf("%s: plan and switch encodings differ\n", name);
+        exit(1);
+    }
+
+    // both timed loops write to the same buffer
+    Clock::time_point t0 = Clock::now();
+    for (int k = 0; k < rounds; k++) {
+        for (size_t r = 0; r < n_rows; r++) {
+            EncodedRecord rec(&enc[r * ROW_BUF], ROW_BUF);
+            switchEncode(ps, &rows[r * n_fields], &rec);
+        }
+    }
+    double switch_enc = nsPerRow(t0, n_total);
+
+    t0 = Clock::now();
+    for (int k = 0; k < rounds; k++) {
+        for (size_t r = 0; r < n_rows; r++) {
+            lens[r] = plan.encode(&rows[r * n_fields], &enc[r * ROW_BUF]);
+        }
+    }
+    double plan_enc = nsPerRow(t0, n_total);
+
+    // records of a table, decoded once first so that every record
+    // has its working buffer, as on a repeated scan
+    std::vector<FieldValue> out(n_fields);
+    std::vector<EncodedRecord> recs;
+    recs.reserve(n_rows);
+    for (size_t r = 0; r < n_rows; r++) {
+        recs.emplace_back(&enc[r * ROW_BUF], lens[r]);
+        switchDecode(ps, &recs[r], out.data());
+    }
+    t0 = Clock::now();
+    uint64_t sum1 = 0;
+    for (int k = 0; k < rounds; k++) {
+        for (size_t r = 0; r < n_rows; r++) {
+            switchDecode(ps, &recs[r], out.data());
+            sum1 += checksum(out.data(), n_fields);
+        }
+    }
+    double switch_dec = nsPerRow(t0, n_total);
+
+    std::vector<uint8_t> work(ROW_BUF);
+    t0 = Clock::now();
+    uint64_t sum2 = 0;
+    for (int k = 0; k < rounds; k++) {
+        for (size_t r = 0; r < n_rows; r++) {
+            plan.decode(&enc[r * ROW_BUF], out.data(), work.data());
+            sum2 += checksum(out.data(), n_fields);
+        }
+    }
+    double plan_dec = nsPerRow(t0, n_total);
+
+    printf("%-10s fields %2d steps %2zu | encode ns/row: switch %7.1f plan %7.1f"
+           " | decode ns/row: switch %7.1f plan %7.1f | %s\n",
+           name, n_fields, plan.getNumSteps(), switch_enc, plan_enc,
+           switch_dec, plan_dec, (sum1 == sum2) ? "ok" : "MISMATCH");
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    size_t n_rows = (argc > 1) ? strtoul(argv[1], nullptr, 10) : 10000;
+    int rounds = (argc > 2) ? atoi(argv[2]) : 100;
+
+    // same schema as sope_record_test.cc
+    RecordDef* ps = new RecordDef(5);
+    ps->setFieldDef(0, TYPE_INT, true);
+    ps->setFieldDef(1, TYPE_LONG, true);
+    ps->setFieldDef(2, TYPE_STRING, false);
+    ps->setFieldDef(3, TYPE_BINARY, true);
+    ps->setFieldDef(4, TYPE_DOUBLE, false);
+    runSchema("example", ps, n_rows, rounds);
+    delete ps;
+
+    // mostly fixed-width, merged into two runs
+    ps = new RecordDef(10);
+    ps->setFieldDef(0, TYPE_INT, true);
+    ps->setFieldDef(1, TYPE_LONG, false);
+    ps->setFieldDef(2, TYPE_DOUBLE, true);
+    ps->setFieldDef(3, TYPE_DATE, true);
+    ps->setFieldDef(4, TYPE_TIMESTAMP, false);
+    ps->setFieldDef(5, TYPE_STRING, true);
+    ps->setFieldDef(6, TYPE_INT, false);
+    ps->setFieldDef(7, TYPE_BOOL, true);
+    ps->setFieldDef(8, TYPE_LONG, true);
+    ps->setFieldDef(9, TYPE_DOUBLE, false);
+    runSchema("wide", ps, n_rows, rounds);
+    delete ps;
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_range_scan.h"
+#include "sope_record_def.h"
+#include "sope_sort.h"
+#include "sope_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace sope_test {
+
+// 64-bit hash of a byte string (MurmurHash64A)
+inline uint64_t hashBytes(const uint8_t* p, uint32_t len) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+    uint64_t h = 0x5350454B4559ULL ^ (len * m);
+    const uint8_t* end = p + (len & ~7U);
+    for (; p != end; p += 8) {
+        uint64_t k;
+        memcpy(&k, p, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+    if (len & 7) {
+        uint64_t k = 0;
+        memcpy(&k, p, len & 7);
+        h ^= k;
+        h *= m;
+    }
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+/**
+ * Blocked Bloom filter over the leading columns of encoded keys.
+ *
+ * The filter holds the encoded bytes of the first n_columns fields of
+ * each key (n_columns = 0 for whole keys). All the bits of a key are
+ * set in one 64-byte block chosen by its hash, so a probe reads one
+ * cache line, and a miss usually stops at its first clear bit.
+ *
+ * Probes take condition keys as built by KeyCondition: when the
+ * condition is an equality on (at least) the filtered columns, its low
+ * and high keys start with the encoded columns, which are hashed as
+ * they are. Any other condition may match and is let through.
+ *
+ *   PrefixBloom bloom(ps, 2, table.getNumRecords());
+ *   bloom.build(table);
+ *   if (bloom.mayContain(cond)) { RangeScan scan(table, cond); ... }
+ *
+ * With 10 bits per key, about 1% of the absent prefixes pass. If the
+ * filter cannot be allocated, everything passes (getNumBytes() is 0).
+ */
+class PrefixBloom {
+public:
+    static const uint32_t BLOCK_BITS = 512;
+
+    PrefixBloom(const RecordDef* ps, int n_columns, size_t expected_keys,
+                int bits_per_key = 10)
+        : pSchema(ps)
+        , nCols((n_columns > 0 && n_columns < ps->getNumFields())
+                ? n_columns : ps->getNumFields()) {
+        size_t bits = expected_keys * (bits_per_key > 0 ? bits_per_key : 1);
+        numBlocks = (bits + BLOCK_BITS - 1) / BLOCK_BITS;
+        if (numBlocks == 0) numBlocks = 1;
+        // about ln 2 * bits per key probes
+        numProbes = (bits_per_key * 69 + 50) / 100;
+        if (numProbes < 1) numProbes = 1;
+        if (numProbes > 16) numProbes = 16;
+        blocks = _RC(uint64_t*, aligned_alloc(BLOCK_BITS / 8,
+                                              numBlocks * BLOCK_BITS / 8));
+        // without memory, a filter that lets everything through
+        if (!blocks) {
+            numBlocks = 0;
+            return;
+        }
+        memset(blocks, 0, numBlocks * BLOCK_BITS / 8);
+    }
+
+    ~PrefixBloom() { ::free(blocks); }
+
+    PrefixBloom(const PrefixBloom&) = delete;
+    PrefixBloom& operator=(const PrefixBloom&) = delete;
+
+    // adds the leading columns of an encoded record
+    void add(KeyRef rec) {
+        uint32_t len = rec.len;
+        if (nCols < pSchema->getNumFields()) prefixLen(rec, len);
+        addHash(hashBytes(rec.data, len));
+    }
+
+    void build(const Table& t) {
+        for (int i = 0; i < t.getNumRecords(); i++) {
+            add(t.getArena().getKey(t.getHandle(i)));
+        }
+    }
+
+    // key starts with the encoded filtered columns, e.g. a record
+    bool mayContain(KeyRef key) const {
+        uint32_t len;
+        if (!prefixLen(key, len)) return true;
+        return mayContainHash(hashBytes(key.data, len));
+    }
+
+    // condition keys: filtered only for an equality on the columns
+    bool mayContain(KeyRef low, KeyRef high) const {
+        uint32_t len;
+        if (!prefixLen(low, len)) return true;
+        if (high.len < len || memcmp(low.data, high.data, len) != 0) return true;
+        return mayContainHash(hashBytes(low.data, len));
+    }
+
+    bool mayContain(const KeyCondition& cond) const {
+        return mayContain(cond.getLow(), cond.getHigh());
+    }
+
+    size_t getNumBytes() const { return numBlocks * BLOCK_BITS / 8; }
+
+private:
+    // the block from the high half of the hash, the bits from the low
+    // half by double hashing
+    const uint64_t* blockOf(uint64_t h) const {
+        size_t b = (size_t)(((h >> 32) * (uint64_t)numBlocks) >> 32);
+        return blocks + b * (BLOCK_BITS / 64);
+    }
+
+    void addHash(uint64_t h) {
+        if (!blocks) return;
+        uint64_t* block = const_cast<uint64_t*>(blockOf(h));
+        uint32_t a = (uint32_t)h;
+        uint32_t delta = (a >> 17) | (a << 15);
+        for (uint32_t i = 0; i < numProbes; i++, a += delta) {
+            uint32_t bit = a % BLOCK_BITS;
+            block[bit / 64] |= 1ULL << (bit % 64);
+        }
+    }
+
+    bool mayContainHash(uint64_t h) const {
+        if (!blocks) return true;
+        const uint64_t* block = blockOf(h);
+        uint32_t a = (uint32_t)h;
+        uint32_t delta = (a >> 17) | (a << 15);
+        for (uint32_t i = 0; i < numProbes; i++, a += delta) {
+            uint32_t bit = a % BLOCK_BITS;
+            if (!(block[bit / 64] & (1ULL << (bit % 64)))) return false;
+        }
+        return true;
+    }
+
+    // length of the filtered columns at the start of key, false if
+    // key does not hold all of them (e.g. a condition on fewer columns)
+    bool prefixLen(KeyRef key, uint32_t& len) const {
+        uint32_t off = 0;
+        for (int i = 0; i < nCols; i++) {
+            uint32_t field_len;
+            const FieldDef& fd = pSchema->getFieldDef(i);
+            if (!EncodedRecord::fieldLen(key.data + off, key.len - off, fd.type,
+                                         fd.asc, fd.enc, field_len)) {
+                return false;
+            }
+            off += field_len;
+        }
+        len = off;
+        return true;
+    }
+
+    const RecordDef* pSchema;
+    int              nCols;
+    size_t           numBlocks;
+    uint32_t         numProbes;
+    uint64_t*        blocks;
+};
+
+}
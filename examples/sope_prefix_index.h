@@ -0,0 +1,176 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_sort.h"
+#include "sope_table.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace sope_test {
+
+/**
+ * Learned index over the 8-byte key prefixes of a sorted table.
+ *
+ * Encoded keys compare as big-endian bytes, so keyPrefix() is a
+ * non-decreasing function of the position in a sorted table. The index
+ * keeps the prefixes in a dense array, and approximates position as a
+ * function of prefix with line segments, each accurate to max_error
+ * positions for the first record of every prefix it covers. The
+ * segments are fitted in one pass over the table (shrinking cone: the
+ * range of slopes that keeps every point so far within the error
+ * narrows with each point, and a new segment starts when it is empty).
+ *
+ * lowerBound(key) then:
+ * - finds the segment of the key's prefix (a binary search over the
+ *   segment starts, a small array),
+ * - predicts a position and searches the prefix array within
+ *   +/- max_error of it, widening the window if the prefix is not
+ *   inside (a prefix that is not in the table can be further off),
+ * - compares whole keys only among the records with the same prefix.
+ *
+ * On keys led by a near-uniform column (ids, timestamps) this replaces
+ * the log2(n) record reads of a binary search with a few cache lines
+ * of the prefix array. Keys whose first 8 bytes repeat a lot (e.g. a
+ * leading string with a common beginning) leave long runs of equal
+ * prefixes to be searched by whole keys, and gain nothing over a
+ * binary search. The table must not change after the build.
+ */
+class PrefixIndex {
+public:
+    explicit PrefixIndex(const Table& t, uint32_t max_error = 32)
+        : table(t)
+        , maxError(max_error) {
+        build();
+    }
+
+    // first record of the table not less than key
+    int lowerBound(KeyRef key) const {
+        int n = prefixes.size();
+        if (n == 0) return 0;
+        uint64_t p = keyPrefix(key);
+        int first = firstOf(p);
+        if (first == n || prefixes[first] != p) return first;
+        // records with the same prefix: compare whole keys
+        int end = firstAfter(p, first);
+        int count = end - first;
+        while (count > 0) {
+            int half = count / 2;
+            KeyRef k = table.getArena().getKey(table.getHandle(first + half));
+            if (compareKeys(k, key) < 0) {
+                first += half + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        return first;
+    }
+
+    size_t getNumSegments() const { return segments.size(); }
+
+private:
+    struct Segment {
+        uint64_t start;     // first prefix covered
+        double   slope;
+        int      pos;       // position of start
+    };
+
+    void build() {
+        int n = table.getNumRecords();
+        prefixes.resize(n);
+        double lo = 0;
+        double hi = std::numeric_limits<double>::infinity();
+        Segment seg = {0, 0, 0};
+        for (int i = 0; i < n; i++) {
+            uint64_t p = keyPrefix(table.getArena().getKey(table.getHandle(i)));
+            prefixes[i] = p;
+            // the model is fitted to the first record of each prefix
+            if (i > 0 && p == prefixes[i - 1]) continue;
+            if (i == 0) {
+                seg = Segment{p, 0, i};
+                continue;
+            }
+            double dx = (double)(p - seg.start);
+            double s_lo = (i - (double)maxError - seg.pos) / dx;
+            double s_hi = (i + (double)maxError - seg.pos) / dx;
+            if (s_lo > hi || s_hi < lo) {
+                closeSegment(seg, lo, hi);
+                seg = Segment{p, 0, i};
+                lo = 0;
+                hi = std::numeric_limits<double>::infinity();
+                continue;
+            }
+            lo = std::max(lo, s_lo);
+            hi = std::min(hi, s_hi);
+        }
+        if (n > 0) closeSegment(seg, lo, hi);
+    }
+
+    void closeSegment(Segment seg, double lo, double hi) {
+        seg.slope = (hi == std::numeric_limits<double>::infinity()) ? lo
+                                                                    : (lo + hi) / 2;
+        segments.push_back(seg);
+    }
+
+    // first position with a prefix not below p
+    int firstOf(uint64_t p) const {
+        int n = prefixes.size();
+        // last segment starting at or before p
+        auto it = std::upper_bound(segments.begin(), segments.end(), p,
+                                   [](uint64_t v, const Segment& s) {
+                                       return v < s.start;
+                                   });
+        if (it == segments.begin()) return 0;
+        const Segment& s = *(it - 1);
+        double guess = s.pos + s.slope * (double)(p - s.start);
+        int pos = (guess >= n) ? n - 1 : (int)guess;
+        int lo = std::max(pos - (int)maxError, 0);
+        int hi = std::min(pos + (int)maxError + 1, n);
+        // widen until prefixes[lo - 1] < p <= prefixes[hi]
+        for (int step = maxError + 1; lo > 0 && prefixes[lo - 1] >= p; step *= 2) {
+            hi = lo;
+            lo = std::max(lo - step, 0);
+        }
+        for (int step = maxError + 1; hi < n && prefixes[hi - 1] < p; step *= 2) {
+            lo = hi;
+            hi = std::min(hi + step, n);
+        }
+        return std::lower_bound(prefixes.begin() + lo, prefixes.begin() + hi, p)
+               - prefixes.begin();
+    }
+
+    // first position after `first` with a prefix above p
+    int firstAfter(uint64_t p, int first) const {
+        int n = prefixes.size();
+        int lo = first;
+        int hi = first + 1;
+        for (int step = 1; hi < n && prefixes[hi] <= p; step *= 2) {
+            lo = hi;
+            hi = std::min(hi + step, n);
+        }
+        return std::upper_bound(prefixes.begin() + lo, prefixes.begin() + hi, p)
+               - prefixes.begin();
+    }
+
+    const Table&          table;
+    uint32_t              maxError;
+    std::vector<uint64_t> prefixes;
+    std::vector<Segment>  segments;
+};
+
+}
@@ -0,0 +1,179 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+#include "sope_record_def.h"
+#include "sope_sort.h"
+#include "sope_table.h"
+
+#include <vector>
+
+namespace sope_test {
+
+/**
+ * Projected decoding of a batch of records.
+ *
+ * Given a column mask over a RecordDef, decode() fills in only the
+ * selected columns. The other fields are skipped as cheaply as their
+ * type allows: a fixed-width field is a jump of LEN_NULL or
+ * LEN_NULL + width depending on its indicator, a string or binary a
+ * terminator search. Fields after the last selected one are not
+ * looked at.
+ *
+ * Output is column-major: column c (the c-th selected field) of
+ * record r is out[c * n + r]. Ascending strings, and ascending
+ * binaries without 0x00 bytes, point into the records; the other
+ * variable-length values are decoded into a buffer of the Projection,
+ * valid until the next decode().
+ */
+class Projection {
+public:
+    Projection(const RecordDef* ps, const std::vector<bool>& mask)
+        : needsWork(false) {
+        int last = -1;
+        for (int i = 0; i < ps->getNumFields() && i < (int)mask.size(); i++) {
+            if (mask[i]) last = i;
+        }
+        for (int i = 0; i <= last; i++) {
+            const FieldDef& fd = ps->getFieldDef(i);
+            Step s;
+            s.type = fd.type;
+            s.asc = fd.asc;
+            s.enc = fd.enc;
+            s.nullInd = fd.asc ? NULL_ASC : NULL_DESC;
+            s.len = (fd.type == TYPE_NULL) ? 0 : fd.len;
+            s.column = -1;
+            if (mask[i]) {
+                s.column = columns.size();
+                columns.push_back(i);
+                needsWork |= (fd.type == TYPE_BINARY || fd.type == TYPE_OBJECT ||
+                              (fd.type == TYPE_STRING && !fd.asc) ||
+                              fd.enc == ENCODING_GROUP);
+            }
+            steps.push_back(s);
+        }
+    }
+
+    // number of selected columns, and the field of each
+    int getNumColumns() const { return columns.size(); }
+    int getField(int c) const { return columns[c]; }
+
+    // n records given as (data, length)
+    void decode(const KeyRef* recs, size_t n, FieldValue* out) {
+        if (needsWork) {
+            // decoded values are never longer than their records
+            size_t total = 0;
+            for (size_t r = 0; r < n; r++) total += recs[r].len;
+            if (work.size() < total) work.resize(total);
+        }
+        uint8_t* pw = work.data();
+        for (size_t r = 0; r < n; r++) {
+            decodeRecord(recs[r].data, out + r, n, pw);
+        }
+    }
+
+    // records [first, first + n) of a table
+    void decode(const Table& t, int first, size_t n, FieldValue* out) {
+        keys.resize(n);
+        for (size_t r = 0; r < n; r++) {
+            keys[r] = t.getArena().getKey(t.getHandle(first + r));
+        }
+        decode(keys.data(), n, out);
+    }
+
+private:
+    struct Step {
+        Type     type;
+        bool     asc;
+        Encoding enc;
+        uint8_t  nullInd;
+        uint32_t len;       // fixed-width types
+        int      column;    // -1: skipped
+    };
+
+    // column c of this record goes to out[c * stride]
+    void decodeRecord(const uint8_t* p, FieldValue* out, size_t stride,
+                      uint8_t*& pw) const {
+        for (const Step& s : steps) {
+            bool isNull = (*p == s.nullInd);
+            if (s.column < 0) {
+                p += LEN_NULL;
+                if (!isNull) p += EncodedRecord::valueLen(p, s.type, s.asc, s.enc);
+                continue;
+            }
+            FieldValue& v = out[s.column * stride];
+            v.isNull = isNull;
+            p += LEN_NULL;
+            if (isNull) continue;
+            if (s.enc == ENCODING_GROUP) {
+                p += decode_group(p, pw, v.len, s.asc);
+                v.ptr = pw;
+                pw += v.len;
+                continue;
+            }
+            if (s.enc == ENCODING_VARINT) {
+                switch (s.type) {
+                case TYPE_INT:       p += decode_varint(p, v.i, s.asc); break;
+                case TYPE_TIMESTAMP: p += decode_uvarint(p, v.ts, s.asc); break;
+                default:             p += decode_varint(p, v.l, s.asc); break;
+                }
+                continue;
+            }
+            switch (s.type) {
+            case TYPE_INT:       v.i = decode_int(p, s.asc); break;
+            case TYPE_LONG:      v.l = decode_long(p, s.asc); break;
+            case TYPE_DATE:      v.l = decode_date(p, s.asc); break;
+            case TYPE_DOUBLE:    v.d = decode_double(p, s.asc); break;
+            case TYPE_BOOL:      v.b = s.asc ? *p != 0 : *p == 0; break;
+            case TYPE_TIMESTAMP: v.ts = decode_timestamp(p, s.asc); break;
+            case TYPE_STRING:
+                if (s.asc) {
+                    v.len = get_string_len(p, true);
+                    v.ptr = p;
+                } else {
+                    v.len = decode_string(p, pw, false);
+                    v.ptr = pw;
+                    pw += v.len;
+                }
+                p += v.len + STRING_PAD_LEN;
+                continue;
+            case TYPE_BINARY:
+            case TYPE_OBJECT:
+                if (s.asc && get_unescaped_bytes_len(p, v.len)) {
+                    v.ptr = p;
+                    p += v.len + BINARY_PAD_LEN;
+                } else {
+                    p += decode_bytes(p, pw, v.len, s.asc) + BINARY_PAD_LEN;
+                    v.ptr = pw;
+                    pw += v.len;
+                }
+                continue;
+            case TYPE_NULL:
+                v.isNull = true;
+                continue;
+            }
+            p += s.len;
+        }
+    }
+
+    std::vector<Step>    steps;
+    std::vector<int>     columns;
+    bool                 needsWork;
+    std::vector<uint8_t> work;
+    std::vector<KeyRef>  keys;
+};
+
+}
@@ -0,0 +1,422 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+#include "sope_record_def.h"
+#include "sope_sort.h"
+#include "sope_table.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <vector>
+
+namespace sope_test {
+
+/**
+ * Condition keys for a range search, [low, high).
+ *
+ * Columns are constrained from the first one on: any number of
+ * equalities, then optionally one range. The columns after that are
+ * not constrained.
+ *
+ *   KeyCondition cond(ps);
+ *   cond.equal(v0).range(&lo, true, nullptr, false);    // f0 = v0, f1 >= lo
+ *   RangeScan scan(table, cond);
+ *   KeyRef rec;
+ *   while (scan.next(rec)) { ... }
+ *
+ * The keys follow the indicator conventions of sope_encoded_record.h:
+ * - a value is written with the not-NULL condition indicator, the
+ *   same byte as the not-NULL field indicator;
+ * - a NULL point query (equal() with a NULL value, or isNull()) uses
+ *   the NULL point condition indicator, the same byte as the NULL
+ *   field indicator;
+ * - the end of a key is either "before" or "after" all the records
+ *   that start with it. "after" appends the NULL end condition 0xFF,
+ *   which is above every indicator; "before" appends the NULL start
+ *   condition 0x00 when columns follow, below every indicator.
+ *
+ * range() takes its bounds in value order. NULL is the smallest
+ * value, but does not match a range: an open lower bound of an
+ * ascending column starts at the not-NULL indicator, and an open lower
+ * bound of a descending column ends (in bytes) at the NULL indicator.
+ */
+class KeyCondition {
+public:
+    explicit KeyCondition(const RecordDef* ps)
+        : pSchema(ps)
+        , nCols(0)
+        , closed(false)
+        , lowMark(0)
+        , highMark(0) {
+        mark(false, true);
+    }
+
+    // column == v; a NULL v matches the NULLs of the column
+    KeyCondition& equal(const FieldValue& v) {
+        assert(!closed && nCols < pSchema->getNumFields());
+        const FieldDef& fd = pSchema->getFieldDef(nCols++);
+        unmark();
+        appendValue(low, fd, v);
+        appendValue(high, fd, v);
+        mark(false, true);
+        return *this;
+    }
+
+    KeyCondition& isNull() {
+        return equal(FieldValue());
+    }
+
+    /**
+     * lo < column < hi, or <= when inclusive; a null pointer leaves
+     * that side open (but NULLs still do not match). No column can be
+     * constrained after a range.
+     */
+    KeyCondition& range(const FieldValue* lo, bool lo_incl,
+                        const FieldValue* hi, bool hi_incl) {
+        assert(!closed && nCols < pSchema->getNumFields());
+        assert((!lo || !lo->isNull) && (!hi || !hi->isNull));
+        const FieldDef& fd = pSchema->getFieldDef(nCols++);
+        closed = true;
+        unmark();
+        // for a descending column the larger value has the smaller bytes
+        const FieldValue* from = fd.asc ? lo : hi;
+        const FieldValue* to = fd.asc ? hi : lo;
+        bool from_incl = fd.asc ? lo_incl : hi_incl;
+        bool to_incl = fd.asc ? hi_incl : lo_incl;
+        bool low_after = false;
+        bool high_after = true;
+        if (from) {
+            appendValue(low, fd, *from);
+            low_after = !from_incl;
+        } else {
+            // first non-NULL value
+            putIndicator(low, NOT_NULL);
+        }
+        if (to) {
+            appendValue(high, fd, *to);
+            high_after = to_incl;
+        } else if (!fd.asc) {
+            // the NULLs of a descending column come after its values
+            putIndicator(high, NULL_POINT);
+            high_after = false;
+        }
+        mark(low_after, high_after);
+        return *this;
+    }
+
+    KeyRef getLow() const  { return KeyRef{low.data(), (uint32_t)low.size()}; }
+    KeyRef getHigh() const { return KeyRef{high.data(), (uint32_t)high.size()}; }
+
+    // number of constrained columns
+    int getNumColumns() const { return nCols; }
+
+private:
+    enum Indicator { NOT_NULL, NULL_POINT, COND_START, COND_END };
+
+    // the last column constrained so far
+    bool getAsc() const {
+        return pSchema->isAsc(nCols - 1);
+    }
+
+    // an indicator byte at the end of key
+    void putIndicator(std::vector<uint8_t>& key, Indicator ind) {
+        size_t pos = key.size();
+        key.resize(pos + LEN_NULL + 1);
+        EncodedRecord rec(key.data(), key.size());
+        rec.setPos(pos);
+        switch (ind) {
+        case NOT_NULL:   rec.putNotNullConditionIndicator(getAsc()); break;
+        case NULL_POINT: rec.putNullPointConditionIndicator(getAsc()); break;
+        case COND_START: rec.putNullConditionIndicator(true); break;
+        case COND_END:   rec.putNullConditionIndicator(false); break;
+        }
+        key.resize(rec.getPos());
+    }
+
+    // indicator and value of a column
+    void appendValue(std::vector<uint8_t>& key, const FieldDef& fd,
+                     const FieldValue& v) {
+        if (v.isNull || fd.type == TYPE_NULL) {
+            putIndicator(key, NULL_POINT);
+            return;
+        }
+        putIndicator(key, NOT_NULL);
+        size_t pos = key.size();
+        // room for the value: an escaped binary at worst, or groups
+        key.resize(pos + fd.len + 2 * v.len + GROUP_LEN + BINARY_PAD_LEN);
+        EncodedRecord rec(key.data(), key.size());
+        rec.setPos(pos);
+        if (fd.enc == ENCODING_GROUP) {
+            rec.putGroup(v.ptr, v.len, fd.asc);
+            key.resize(rec.getPos());
+            return;
+        }
+        if (fd.enc == ENCODING_VARINT) {
+            switch (fd.type) {
+            case TYPE_INT:       rec.putVarint(v.i, fd.asc); break;
+            case TYPE_TIMESTAMP: rec.putUVarint(v.ts, fd.asc); break;
+            default:             rec.putVarint(v.l, fd.asc); break;
+            }
+            key.resize(rec.getPos());
+            return;
+        }
+        switch (fd.type) {
+        case TYPE_INT:       rec.put(v.i, fd.asc); break;
+        case TYPE_LONG:
+        case TYPE_DATE:      rec.put(v.l, fd.asc); break;
+        case TYPE_DOUBLE:    rec.put(v.d, fd.asc); break;
+        case TYPE_BOOL:      rec.put(v.b, fd.asc); break;
+        case TYPE_TIMESTAMP: rec.put(v.ts, fd.asc); break;
+        case TYPE_STRING:    rec.put(_SCCC(v.ptr), v.len, fd.asc); break;
+        case TYPE_BINARY:
+        case TYPE_OBJECT:    rec.put(v.ptr, v.len, fd.asc); break;
+        case TYPE_NULL:      break;
+        }
+        key.resize(rec.getPos());
+    }
+
+    // ends the keys before or after the records starting with them
+    void mark(bool low_after, bool high_after) {
+        size_t low_len = low.size();
+        size_t high_len = high.size();
+        if (low_after) {
+            putIndicator(low, COND_END);
+        } else if (nCols < pSchema->getNumFields()) {
+            putIndicator(low, COND_START);
+        }
+        if (high_after) putIndicator(high, COND_END);
+        lowMark = low.size() - low_len;
+        highMark = high.size() - high_len;
+    }
+
+    void unmark() {
+        low.resize(low.size() - lowMark);
+        high.resize(high.size() - highMark);
+        lowMark = highMark = 0;
+    }
+
+    const RecordDef*     pSchema;
+    int                  nCols;
+    bool                 closed;     // a range was given
+    std::vector<uint8_t> low;
+    std::vector<uint8_t> high;
+    size_t               lowMark;    // bytes appended by mark()
+    size_t               highMark;
+};
+
+// first record of a sorted table, from `first` on, not less than key
+inline int lowerBound(const Table& t, KeyRef key, int first = 0) {
+    const RecordArena& arena = t.getArena();
+    int n = t.getNumRecords() - first;
+    while (n > 0) {
+        int half = n / 2;
+        if (compareKeys(arena.getKey(t.getHandle(first + half)), key) < 0) {
+            first += half + 1;
+            n -= half + 1;
+        } else {
+            n = half;
+        }
+    }
+    return first;
+}
+
+/**
+ * Scan of the records of a sorted table within [low, high).
+ *
+ * The start is found by a binary search on low; next() then returns
+ * records in order until one is not below high. Records are compared
+ * as bytes only, nothing is decoded. The scan keeps a reference to the
+ * high key, so the KeyCondition must outlive it.
+ */
+class RangeScan {
+public:
+    RangeScan(const Table& t, KeyRef low, KeyRef high)
+        : table(t)
+        , highKey(high)
+        , pos(lowerBound(t, low))
+        , end(t.getNumRecords()) {}
+
+    RangeScan(const Table& t, const KeyCondition& cond)
+        : RangeScan(t, cond.getLow(), cond.getHigh()) {}
+
+    bool next(KeyRef& rec) {
+        if (pos == end) return false;
+        KeyRef k = table.getArena().getKey(table.getHandle(pos));
+        if (compareKeys(k, highKey) >= 0) {
+            end = pos;
+            return false;
+        }
+        pos++;
+        rec = k;
+        return true;
+    }
+
+    // index in the table of the record next() returns next
+    int getPos() const { return pos; }
+
+private:
+    const Table& table;
+    KeyRef       highKey;
+    int          pos;
+    int          end;
+};
+
+// records [begin, end) of a table
+struct RowRange {
+    int begin;
+    int end;
+};
+
+/**
+ * Many lookups into one sorted table at a time.
+ *
+ * Independent binary searches each pay about log2(n) cache misses,
+ * most of them on the same top levels of the table. Here the probe
+ * keys are sorted first, then resolved in a single pass from the
+ * first record to the last: each probe starts from the position of
+ * the previous one, checks it (equal probes cost one comparison) and
+ * gallops forward by 1, 2, 4, ... records before a binary search of
+ * the last step. A probe k records after the previous one thus costs
+ * about 2 log2(k) comparisons, near records that were just read.
+ * The record the next comparison may need is prefetched, on both
+ * sides of a binary search step.
+ *
+ * The results are returned in the order of the probes.
+ */
+class BatchLookup {
+public:
+    explicit BatchLookup(const Table& t) : table(t) {}
+
+    // out[i] = lowerBound(t, keys[i])
+    void lowerBounds(const KeyRef* keys, size_t n, int* out) {
+        probes.resize(n);
+        for (size_t i = 0; i < n; i++) setProbe(probes[i], keys[i], i);
+        resolve(out);
+    }
+
+    // out[i] = the records within [lows[i], highs[i])
+    void ranges(const KeyRef* lows, const KeyRef* highs, size_t n,
+                RowRange* out) {
+        probes.resize(2 * n);
+        for (size_t i = 0; i < n; i++) {
+            setProbe(probes[2 * i], lows[i], 2 * i);
+            setProbe(probes[2 * i + 1], highs[i], 2 * i + 1);
+        }
+        pos.resize(2 * n);
+        resolve(pos.data());
+        for (size_t i = 0; i < n; i++) {
+            out[i].begin = pos[2 * i];
+            out[i].end = std::max(pos[2 * i], pos[2 * i + 1]);
+        }
+    }
+
+    void ranges(const KeyCondition* conds, size_t n, RowRange* out) {
+        lows.resize(n);
+        highs.resize(n);
+        for (size_t i = 0; i < n; i++) {
+            lows[i] = conds[i].getLow();
+            highs[i] = conds[i].getHigh();
+        }
+        ranges(lows.data(), highs.data(), n, out);
+    }
+
+private:
+    struct Probe {
+        uint64_t prefix;
+        KeyRef   key;
+        size_t   slot;      // index of the result
+    };
+
+    static void setProbe(Probe& p, KeyRef key, size_t slot) {
+        p.prefix = keyPrefix(key);
+        p.key = key;
+        p.slot = slot;
+    }
+
+    void resolve(int* out) {
+        std::sort(probes.begin(), probes.end(),
+                  [](const Probe& a, const Probe& b) {
+                      if (a.prefix != b.prefix) return a.prefix < b.prefix;
+                      uint32_t from = std::min(std::min(a.key.len, b.key.len),
+                                               KEY_PREFIX_LEN);
+                      return compareKeys(a.key, b.key, from) < 0;
+                  });
+        int at = 0;
+        for (const Probe& p : probes) {
+            at = gallop(at, p.key);
+            out[p.slot] = at;
+        }
+    }
+
+    // lowerBound() over records [lo, hi)
+    int search(int lo, int hi, KeyRef key) const {
+        int count = hi - lo;
+        while (count > 0) {
+            int half = count / 2;
+            prefetch(lo + half / 2);
+            prefetch(lo + half + 1 + (count - half - 1) / 2);
+            if (less(lo + half, key)) {
+                lo += half + 1;
+                count -= half + 1;
+            } else {
+                count = half;
+            }
+        }
+        return lo;
+    }
+
+    KeyRef keyAt(int i) const {
+        return table.getArena().getKey(table.getHandle(i));
+    }
+
+    bool less(int i, KeyRef key) const {
+        return compareKeys(keyAt(i), key) < 0;
+    }
+
+    void prefetch(int i) const {
+        if (i < table.getNumRecords()) {
+            __builtin_prefetch(table.getArena().getData(table.getHandle(i)));
+        }
+    }
+
+    // lowerBound(table, key, from), when it is known to be >= from
+    int gallop(int from, KeyRef key) const {
+        int n = table.getNumRecords();
+        if (from == n || !less(from, key)) return from;
+        // record lo - 1 is below key; find a record that is not
+        int lo = from + 1;
+        int hi = n;
+        for (int step = 1; lo + step - 1 < n; step *= 2) {
+            int i = lo + step - 1;
+            prefetch(i + 2 * step);
+            if (!less(i, key)) {
+                hi = i;
+                break;
+            }
+            lo = i + 1;
+        }
+        return search(lo, hi, key);
+    }
+
+    const Table&        table;
+    std::vector<Probe>  probes;
+    std::vector<int>    pos;
+    std::vector<KeyRef> lows;
+    std::vector<KeyRef> highs;
+};
+
+}
@@ -0,0 +1,181 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+#include "sope_sort.h"
+
+#include <stdlib.h>
+#include <vector>
+
+namespace sope {
+
+/**
+ * Encoded record of a RecordArena: the record bytes are at `offset`
+ * in the arena, `len` is the encoded length (getEndPos()).
+ */
+struct RecordHandle {
+    uint64_t offset;
+    uint32_t len;
+};
+
+/**
+ * Append-only storage for encoded records.
+ *
+ * Records are copied back to back into chunks of 2^chunk_bits bytes
+ * (a record never spans two chunks). A record is then referred to by a
+ * RecordHandle, where offset = chunk number << chunk_bits | position
+ * in the chunk. A record larger than a chunk gets an allocation of its
+ * own, kept apart from the chunks, and offset = LARGE_RECORD | its
+ * number.
+ *
+ * So a table of n records costs n / (chunk size / record length)
+ * mallocs instead of two per record, and handles can be sorted and
+ * copied around without touching the records. clear() drops all the
+ * records at once: it frees the large records and rewinds to the first
+ * chunk, and the chunks are reused as they are.
+ *
+ * reserve() returns null, and append() false, if out of memory.
+ */
+class RecordArena {
+public:
+    static const uint64_t LARGE_RECORD = 1ULL << 63;
+
+    explicit RecordArena(uint32_t chunk_bits = 20)
+        : chunkBits(chunk_bits)
+        , chunkSize(1U << chunk_bits)
+        , curChunk(0)
+        , curPos(0)
+        , largeBytes(0)
+        , largeReserved(0) {}
+
+    ~RecordArena() {
+        for (uint8_t* p : chunks) ::free(p);
+        for (uint8_t* p : large) ::free(p);
+    }
+
+    RecordArena(const RecordArena&) = delete;
+    RecordArena& operator=(const RecordArena&) = delete;
+
+    /**
+     * Space for a record of up to max_len bytes. The record can be
+     * encoded there directly, e.g. with EncodedRecord(p, max_len),
+     * then commit() gives its handle. Without commit() the space is
+     * reused by the next reserve().
+     */
+    uint8_t* reserve(uint32_t max_len) {
+        if (largeReserved) {
+            ::free(large.back());
+            large.pop_back();
+            largeBytes -= largeReserved;
+            largeReserved = 0;
+        }
+        if (max_len > chunkSize) {
+            uint8_t* p = _SCU(malloc(max_len));
+            if (!p) return nullptr;
+            large.push_back(p);
+            largeBytes += max_len;
+            largeReserved = max_len;
+            return p;
+        }
+        // a full chunk is left even for an empty record, so that positions
+        // stay below the chunk size
+        if (curChunk < chunks.size() &&
+            (curPos + max_len > chunkSize || curPos == chunkSize)) {
+            curChunk++;
+            curPos = 0;
+        }
+        if (curChunk == chunks.size()) {
+            uint8_t* p = _SCU(malloc(chunkSize));
+            if (!p) return nullptr;
+            chunks.push_back(p);
+        }
+        return chunks[curChunk] + curPos;
+    }
+
+    RecordHandle commit(uint32_t len) {
+        RecordHandle h;
+        h.len = len;
+        if (largeReserved) {
+            largeReserved = 0;
+            h.offset = LARGE_RECORD | (large.size() - 1);
+            return h;
+        }
+        h.offset = ((uint64_t)curChunk << chunkBits) | curPos;
+        curPos += len;
+        return h;
+    }
+
+    // copies a record into the arena
+    bool append(const void* p, uint32_t len, RecordHandle& h) {
+        uint8_t* dst = reserve(len);
+        if (!dst) return false;
+        memcpy(dst, p, len);
+        h = commit(len);
+        return true;
+    }
+
+    bool append(const EncodedRecord* pr, RecordHandle& h) {
+        return append(pr->getData(), (uint32_t)pr->getEndPos(), h);
+    }
+
+    uint8_t* getData(RecordHandle h) {
+        if (h.offset & LARGE_RECORD) return large[h.offset & ~LARGE_RECORD];
+        return chunks[h.offset >> chunkBits] + (h.offset & (chunkSize - 1));
+    }
+
+    const uint8_t* getData(RecordHandle h) const {
+        if (h.offset & LARGE_RECORD) return large[h.offset & ~LARGE_RECORD];
+        return chunks[h.offset >> chunkBits] + (h.offset & (chunkSize - 1));
+    }
+
+    KeyRef getKey(RecordHandle h) const {
+        return KeyRef{getData(h), h.len};
+    }
+
+    // Drops all records; the chunks are kept for the next records.
+    void clear() {
+        for (uint8_t* p : large) ::free(p);
+        large.clear();
+        largeBytes = 0;
+        largeReserved = 0;
+        curChunk = 0;
+        curPos = 0;
+    }
+
+    // bytes held in chunks and large records
+    size_t getAllocated() const {
+        return chunks.size() * (size_t)chunkSize + largeBytes;
+    }
+
+private:
+    uint32_t              chunkBits;
+    uint32_t              chunkSize;
+    std::vector<uint8_t*> chunks;       // all chunkSize bytes
+    std::vector<uint8_t*> large;        // records larger than a chunk
+    size_t                curChunk;
+    uint32_t              curPos;
+    size_t                largeBytes;
+    uint32_t              largeReserved;    // length of large.back() if
+                                            // not committed, else 0
+};
+
+// KeyOf for the sort engines of sope_sort.h
+struct ArenaKeys {
+    const RecordArena* arena;
+    KeyRef operator()(const RecordHandle& h) const { return arena->getKey(h); }
+};
+
+}
@@ -0,0 +1,168 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer: Gene Zhang
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_types.h"
+#include "sope_encode.h"
+
+#include <vector>
+
+namespace sope_test {
+
+using namespace sope;
+
+/***************************************
+Definition of FieldDef class
+*****************************************/
+struct FieldDef {
+    Type     type;
+    uint32_t len;
+    bool     asc;
+    Encoding enc;
+
+    FieldDef() : type(TYPE_NULL), len(0), asc(true), enc(ENCODING_DEFAULT) {}
+    FieldDef(Type t, uint32_t l, bool asc_, Encoding enc_ = ENCODING_DEFAULT)
+        : type(t), len(l), asc(asc_), enc(enc_) {}
+};
+
+    
+/***************************************
+Definition of RecordDef class
+*****************************************/
+class RecordDef {
+public:
+    RecordDef(int n_fields)
+        : fields(n_fields) {}
+
+    // enc_ must be one of the type, see isValidEncoding()
+    void setFieldDef(int i, Type t, bool asc_, Encoding enc_ = ENCODING_DEFAULT) {
+        assert(isValidEncoding(t, enc_));
+        fields[i] = FieldDef(t, Typelen(t), asc_, enc_);
+    }
+
+    static bool isGroupType(Type t) {
+        return t == TYPE_STRING || t == TYPE_BINARY || t == TYPE_OBJECT;
+    }
+
+    static bool isVarintType(Type t) {
+        return t == TYPE_INT || t == TYPE_LONG || t == TYPE_DATE ||
+               t == TYPE_TIMESTAMP;
+    }
+
+    // ENCODING_GROUP is for strings and binaries, ENCODING_VARINT for
+    // integers, Date and Timestamp
+    static bool isValidEncoding(Type t, Encoding enc) {
+        switch (enc) {
+        case ENCODING_DEFAULT: return true;
+        case ENCODING_GROUP:   return isGroupType(t);
+        case ENCODING_VARINT:  return isVarintType(t);
+        }
+        return false;
+    }
+
+    Type getType(int i) const {
+        return fields[i].type;
+    }
+
+    uint32_t getLen(int i) const {
+        return fields[i].len;
+    }
+
+    bool isAsc(int i) const {
+        return fields[i].asc;
+    }
+
+    Encoding getEncoding(int i) const {
+        return fields[i].enc;
+    }
+
+    int getNumFields() const {
+        return fields.size();
+    }
+
+    const FieldDef& getFieldDef(int i) const {
+        return fields[i];
+    }
+
+private:
+    std::vector<FieldDef> fields;
+};
+
+/***************************************
+Definition of FieldValue struct:
+one field of a row in native form, used by
+the schema-driven encoders and decoders.
+Date is kept in l, strings and binaries
+in (ptr, len).
+*****************************************/
+struct FieldValue {
+    bool isNull;
+    union {
+        int       i;
+        long      l;
+        double    d;
+        bool      b;
+        Timestamp ts;
+    };
+    const void* ptr;
+    uint32_t    len;
+
+    FieldValue() : isNull(true), l(0), ptr(nullptr), len(0) {}
+};
+
+/**
+ * Exact encoded length of a row (one FieldValue per field), as written
+ * by RecordPlan::encode() or field by field with EncodedRecord: an
+ * indicator per field, the fixed-width values, strings with their pad,
+ * binaries with one more byte per 0x00, fixed groups and varints.
+ * Only binaries are read, to count their zeros; the rest is arithmetic
+ * on the lengths and values.
+ */
+inline uint32_t calcEncodedLen(const RecordDef* ps, const FieldValue* row) {
+    uint32_t len = 0;
+    for (int i = 0; i < ps->getNumFields(); i++) {
+        len += LEN_NULL;
+        if (row[i].isNull) continue;
+        if (ps->getEncoding(i) == ENCODING_GROUP) {
+            len += calc_group_encoded_len(row[i].len);
+            continue;
+        }
+        if (ps->getEncoding(i) == ENCODING_VARINT) {
+            switch (ps->getType(i)) {
+            case TYPE_INT:       len += calc_varint_encoded_len(row[i].i); break;
+            case TYPE_TIMESTAMP: len += calc_uvarint_encoded_len(row[i].ts); break;
+            default:             len += calc_varint_encoded_len(row[i].l); break;
+            }
+            continue;
+        }
+        switch (ps->getType(i)) {
+        case TYPE_STRING:
+            len += calc_string_encoded_len(row[i].len);
+            break;
+        case TYPE_BINARY:
+        case TYPE_OBJECT:
+            len += calc_binary_encoded_len(row[i].ptr, row[i].len);
+            break;
+        case TYPE_NULL:
+            break;
+        default:
+            len += ps->getLen(i);
+            break;
+        }
+    }
+    return len;
+}
+
+}
@@ -0,0 +1,422 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+#include "sope_record_def.h"
+
+#include <vector>
+
+namespace sope_test {
+
+/**
+ * A RecordDef compiled into a flat list of steps.
+ *
+ * The record layout is the one used by sope_record_test.cc: every
+ * field is a NULL / not-NULL indicator byte followed by the value.
+ *
+ * - Each run of consecutive fixed-width fields (INT, LONG, DOUBLE,
+ *   BOOL, DATE, TIMESTAMP) becomes one step. Each member keeps its
+ *   width and a put/get thunk specialized for its type and order, and
+ *   up to the first NULL of the run the members are written at
+ *   constant offsets from the start of the run.
+ * - STRING, BINARY and OBJECT fields get a step whose thunk is
+ *   specialized for the type and order.
+ * - Integers encoded as varints (ENCODING_VARINT) are not fixed-width,
+ *   and get a step each, specialized likewise.
+ *
+ * encode()/decode() are then a loop over the steps, without a type
+ * switch or an isAsc() lookup per field.
+ */
+class RecordPlan {
+public:
+    explicit RecordPlan(const RecordDef* ps) {
+        int n = ps->getNumFields();
+        for (int i = 0; i < n; i++) {
+            const FieldDef& fd = ps->getFieldDef(i);
+            if (fd.enc == ENCODING_VARINT) {
+                steps.push_back(fd.asc ? varintStep<true>(i, fd.type)
+                                       : varintStep<false>(i, fd.type));
+                continue;
+            }
+            if (isFixed(fd.type)) {
+                if (steps.empty() || steps.back().enc != encFixed) {
+                    steps.push_back(makeStep(i, fd.asc, encFixed, decFixed));
+                    steps.back().first = members.size();
+                }
+                Step& s = steps.back();
+                members.push_back(makeMember(i, fd.type, fd.asc, s.runLen));
+                s.count++;
+                s.runLen += LEN_NULL + fd.len;
+                continue;
+            }
+            if (fd.enc == ENCODING_GROUP) {
+                steps.push_back(fd.asc
+                    ? makeStep(i, true, encGroup<true>, decGroup<true>)
+                    : makeStep(i, false, encGroup<false>, decGroup<false>));
+                continue;
+            }
+            switch (fd.type) {
+            case TYPE_STRING:
+                steps.push_back(fd.asc
+                    ? makeStep(i, true, encString<true>, decString<true>)
+                    : makeStep(i, false, encString<false>, decString<false>));
+                break;
+            case TYPE_BINARY:
+            case TYPE_OBJECT:
+                steps.push_back(fd.asc
+                    ? makeStep(i, true, encBinary<true>, decBinary<true>)
+                    : makeStep(i, false, encBinary<false>, decBinary<false>));
+                break;
+            default:
+                steps.push_back(makeStep(i, fd.asc, encNull, decNull));
+                break;
+            }
+        }
+        for (Step& s : steps) s.members = members.data() + s.first;
+    }
+
+    // steps point into members
+    RecordPlan(const RecordPlan&) = delete;
+    RecordPlan& operator=(const RecordPlan&) = delete;
+
+    // Encode a row given as one FieldValue per field. pBuf must be
+    // large enough; returns the encoded length.
+    uint32_t encode(const FieldValue* row, void* pBuf) const {
+        uint8_t* p = _SCU(pBuf);
+        for (const Step& s : steps) p = s.enc(s, row, p);
+        return p - _SCU(pBuf);
+    }
+
+    // Decode a row into one FieldValue per field, returns the bytes
+    // consumed. Ascending strings, and ascending binaries without 0x00
+    // bytes, point into pData; other strings and binaries are decoded
+    // into pWork, which needs as many bytes as the encoded record.
+    uint32_t decode(const void* pData, FieldValue* row, void* pWork) const {
+        const uint8_t* p = _RC(const uint8_t*, pData);
+        uint8_t* work = _SCU(pWork);
+        for (const Step& s : steps) p = s.dec(s, p, row, work);
+        return p - _RC(const uint8_t*, pData);
+    }
+
+    size_t getNumSteps() const { return steps.size(); }
+
+private:
+    struct FixedMember {
+        int      field;
+        uint32_t offset;    // of the indicator, from the start of the run
+        uint32_t width;     // LEN_INT, LEN_LONG, ...
+        uint8_t  nullInd;
+        void (*put)(const FieldValue&, uint8_t*);
+        void (*get)(const uint8_t*, FieldValue&);
+    };
+
+    struct Step;
+    typedef uint8_t* (*EncodeFn)(const Step&, const FieldValue*, uint8_t*);
+    typedef const uint8_t* (*DecodeFn)(const Step&, const uint8_t*,
+                                       FieldValue*, uint8_t*&);
+
+    struct Step {
+        EncodeFn enc;
+        DecodeFn dec;
+        int      field;
+        uint8_t  nullInd;
+        uint8_t  notNullInd;
+        // fixed-width runs only
+        uint32_t first;
+        uint32_t count;
+        uint32_t runLen;
+        const FixedMember* members;
+    };
+
+    static bool isFixed(Type t) {
+        return t == TYPE_INT || t == TYPE_LONG || t == TYPE_DOUBLE ||
+               t == TYPE_BOOL || t == TYPE_DATE || t == TYPE_TIMESTAMP;
+    }
+
+    static Step makeStep(int i, bool asc, EncodeFn enc, DecodeFn dec) {
+        Step s;
+        s.enc = enc;
+        s.dec = dec;
+        s.field = i;
+        s.nullInd = asc ? NULL_ASC : NULL_DESC;
+        s.notNullInd = asc ? NOT_NULL_ASC : NOT_NULL_DESC;
+        s.first = s.count = s.runLen = 0;
+        s.members = nullptr;
+        return s;
+    }
+
+    static uint64_t selectMask(uint64_t v, uint64_t neg, uint64_t pos) {
+        uint64_t s = (uint64_t)((int64_t)v >> 63);
+        return (s & neg) | (~s & pos);
+    }
+
+    template <Type t, bool asc>
+    static void putValue(const FieldValue& v, uint8_t* p) {
+        *p++ = asc ? NOT_NULL_ASC : NOT_NULL_DESC;
+        if (t == TYPE_INT) {
+            uint32_t e = sope::encode(v.i, asc);
+            memcpy(p, &e, sizeof(e));
+        } else if (t == TYPE_LONG || t == TYPE_DATE) {
+            uint64_t e = sope::encode(v.l, asc);
+            memcpy(p, &e, sizeof(e));
+        } else if (t == TYPE_DOUBLE) {
+            // encode(double) without the branch on the sign
+            uint64_t e;
+            memcpy(&e, &v.d, sizeof(e));
+            e ^= selectMask(e, asc ? 0xFFFFFFFFFFFFFFFFULL : 0,
+                            asc ? 0x8000000000000000ULL : 0x7FFFFFFFFFFFFFFFULL);
+            e = _enc64(e);
+            memcpy(p, &e, sizeof(e));
+            SOPE_STAT_ENCODED(KIND_DOUBLE, 1, LEN_DOUBLE);
+        } else if (t == TYPE_TIMESTAMP) {
+            uint64_t e = sope::encode(v.ts, asc);
+            memcpy(p, &e, sizeof(e));
+        } else {
+            *p = asc ? v.b : !v.b;
+            SOPE_STAT_ENCODED(KIND_BOOL, 1, LEN_BOOL);
+        }
+    }
+
+    template <Type t, bool asc>
+    static void getValue(const uint8_t* p, FieldValue& v) {
+        v.isNull = false;
+        if (t == TYPE_INT) v.i = decode_int(p, asc);
+        else if (t == TYPE_LONG || t == TYPE_DATE) v.l = decode_long(p, asc);
+        else if (t == TYPE_DOUBLE) {
+            uint64_t e;
+            memcpy(&e, p, sizeof(e));
+            e = _dec64(e);
+            e ^= selectMask(e, asc ? 0x8000000000000000ULL : 0,
+                            asc ? 0xFFFFFFFFFFFFFFFFULL : 0x7FFFFFFFFFFFFFFFULL);
+            memcpy(&v.d, &e, sizeof(e));
+            SOPE_STAT_DECODED(KIND_DOUBLE, 1, LEN_DOUBLE);
+        }
+        else if (t == TYPE_TIMESTAMP) v.ts = decode_timestamp(p, asc);
+        else {
+            v.b = asc ? *p != 0 : *p == 0;
+            SOPE_STAT_DECODED(KIND_BOOL, 1, LEN_BOOL);
+        }
+    }
+
+    template <Type t>
+    static void setThunks(FixedMember& m, bool asc) {
+        m.put = asc ? putValue<t, true> : putValue<t, false>;
+        m.get = asc ? getValue<t, true> : getValue<t, false>;
+    }
+
+    static FixedMember makeMember(int i, Type t, bool asc, uint32_t offset) {
+        FixedMember m;
+        m.field = i;
+        m.offset = offset;
+        m.width = Typelen(t);
+        m.nullInd = asc ? NULL_ASC : NULL_DESC;
+        switch (t) {
+        case TYPE_INT:       setThunks<TYPE_INT>(m, asc); break;
+        case TYPE_LONG:      setThunks<TYPE_LONG>(m, asc); break;
+        case TYPE_DOUBLE:    setThunks<TYPE_DOUBLE>(m, asc); break;
+        case TYPE_BOOL:      setThunks<TYPE_BOOL>(m, asc); break;
+        case TYPE_DATE:      setThunks<TYPE_DATE>(m, asc); break;
+        default:             setThunks<TYPE_TIMESTAMP>(m, asc); break;
+        }
+        return m;
+    }
+
+    static uint8_t* encFixed(const Step& s, const FieldValue* row, uint8_t* p) {
+        const FixedMember* m = s.members;
+        uint32_t i = 0;
+        // constant offsets up to the first NULL
+        for (; i < s.count && !row[m[i].field].isNull; i++) {
+            m[i].put(row[m[i].field], p + m[i].offset);
+        }
+        if (i == s.count) return p + s.runLen;
+        p += m[i].offset;
+        for (; i < s.count; i++) {
+            if (row[m[i].field].isNull) {
+                *p = m[i].nullInd;
+                p += LEN_NULL;
+            } else {
+                m[i].put(row[m[i].field], p);
+                p += LEN_NULL + m[i].width;
+            }
+        }
+        return p;
+    }
+
+    static const uint8_t* decFixed(const Step& s, const uint8_t* p,
+                                   FieldValue* row, uint8_t*&) {
+        const FixedMember* m = s.members;
+        uint32_t i = 0;
+        // constant offsets up to the first NULL
+        for (; i < s.count && p[m[i].offset] != m[i].nullInd; i++) {
+            m[i].get(p + m[i].offset + LEN_NULL, row[m[i].field]);
+        }
+        if (i == s.count) return p + s.runLen;
+        p += m[i].offset;
+        for (; i < s.count; i++) {
+            if (*p == m[i].nullInd) {
+                row[m[i].field].isNull = true;
+                p += LEN_NULL;
+            } else {
+                m[i].get(p + LEN_NULL, row[m[i].field]);
+                p += LEN_NULL + m[i].width;
+            }
+        }
+        return p;
+    }
+
+    template <bool asc>
+    static uint8_t* encString(const Step& s, const FieldValue* row, uint8_t* p) {
+        const FieldValue& v = row[s.field];
+        if (v.isNull) {
+            *p = s.nullInd;
+            return p + LEN_NULL;
+        }
+        *p = s.notNullInd;
+        return p + LEN_NULL + sope::encode(_SCCC(v.ptr), v.len, p + LEN_NULL, asc);
+    }
+
+    template <bool asc>
+    static const uint8_t* decString(const Step& s, const uint8_t* p,
+                                    FieldValue* row, uint8_t*& work) {
+        FieldValue& v = row[s.field];
+        v.isNull = (*p == s.nullInd);
+        if (v.isNull) return p + LEN_NULL;
+        p += LEN_NULL;
+        if (asc) {
+            v.len = get_string_len(p, true);
+            v.ptr = p;
+            SOPE_STAT_DECODED(KIND_STRING, 1, v.len + STRING_PAD_LEN);
+        } else {
+            v.len = decode_string(p, work, false);
+            v.ptr = work;
+            work += v.len;
+        }
+        return p + v.len + STRING_PAD_LEN;
+    }
+
+    template <bool asc>
+    static uint8_t* encBinary(const Step& s, const FieldValue* row, uint8_t* p) {
+        const FieldValue& v = row[s.field];
+        if (v.isNull) {
+            *p = s.nullInd;
+            return p + LEN_NULL;
+        }
+        *p = s.notNullInd;
+        return p + LEN_NULL + sope::encode(v.ptr, v.len, p + LEN_NULL, asc);
+    }
+
+    template <bool asc>
+    static const uint8_t* decBinary(const Step& s, const uint8_t* p,
+                                    FieldValue* row, uint8_t*& work) {
+        FieldValue& v = row[s.field];
+        v.isNull = (*p == s.nullInd);
+        if (v.isNull) return p + LEN_NULL;
+        p += LEN_NULL;
+        // without 0x00 bytes an ascending value is used in place
+        if (asc && get_unescaped_bytes_len(p, v.len)) {
+            v.ptr = p;
+            SOPE_STAT_DECODED(KIND_BINARY, 1, v.len + BINARY_PAD_LEN);
+            return p + v.len + BINARY_PAD_LEN;
+        }
+        uint32_t consumed = decode_bytes(p, work, v.len, asc);
+        v.ptr = work;
+        work += v.len;
+        return p + consumed + BINARY_PAD_LEN;
+    }
+
+    // strings and binaries in fixed groups (ENCODING_GROUP)
+    template <bool asc>
+    static uint8_t* encGroup(const Step& s, const FieldValue* row, uint8_t* p) {
+        const FieldValue& v = row[s.field];
+        if (v.isNull) {
+            *p = s.nullInd;
+            return p + LEN_NULL;
+        }
+        *p = s.notNullInd;
+        return p + LEN_NULL + encode_group(v.ptr, v.len, p + LEN_NULL, asc);
+    }
+
+    template <bool asc>
+    static const uint8_t* decGroup(const Step& s, const uint8_t* p,
+                                   FieldValue* row, uint8_t*& work) {
+        FieldValue& v = row[s.field];
+        v.isNull = (*p == s.nullInd);
+        if (v.isNull) return p + LEN_NULL;
+        p += LEN_NULL;
+        p += decode_group(p, work, v.len, asc);
+        v.ptr = work;
+        work += v.len;
+        return p;
+    }
+
+    // integers as varints (ENCODING_VARINT); Date is kept as long
+    template <Type t, bool asc>
+    static uint8_t* encVarint(const Step& s, const FieldValue* row, uint8_t* p) {
+        const FieldValue& v = row[s.field];
+        if (v.isNull) {
+            *p = s.nullInd;
+            return p + LEN_NULL;
+        }
+        *p++ = s.notNullInd;
+        if (t == TYPE_INT) return p + encode_varint(v.i, p, asc);
+        if (t == TYPE_TIMESTAMP) return p + encode_uvarint(v.ts, p, asc);
+        return p + encode_varint(v.l, p, asc);
+    }
+
+    template <Type t, bool asc>
+    static const uint8_t* decVarint(const Step& s, const uint8_t* p,
+                                    FieldValue* row, uint8_t*&) {
+        FieldValue& v = row[s.field];
+        v.isNull = (*p == s.nullInd);
+        if (v.isNull) return p + LEN_NULL;
+        p += LEN_NULL;
+        if (t == TYPE_INT) return p + decode_varint(p, v.i, asc);
+        if (t == TYPE_TIMESTAMP) return p + decode_uvarint(p, v.ts, asc);
+        return p + decode_varint(p, v.l, asc);
+    }
+
+    template <bool asc>
+    static Step varintStep(int i, Type t) {
+        switch (t) {
+        case TYPE_INT:
+            return makeStep(i, asc, encVarint<TYPE_INT, asc>,
+                            decVarint<TYPE_INT, asc>);
+        case TYPE_TIMESTAMP:
+            return makeStep(i, asc, encVarint<TYPE_TIMESTAMP, asc>,
+                            decVarint<TYPE_TIMESTAMP, asc>);
+        default:
+            return makeStep(i, asc, encVarint<TYPE_LONG, asc>,
+                            decVarint<TYPE_LONG, asc>);
+        }
+    }
+
+    // TYPE_NULL: only the indicator is stored
+    static uint8_t* encNull(const Step& s, const FieldValue*, uint8_t* p) {
+        *p = s.nullInd;
+        return p + LEN_NULL;
+    }
+
+    static const uint8_t* decNull(const Step& s, const uint8_t* p,
+                                  FieldValue* row, uint8_t*&) {
+        row[s.field].isNull = true;
+        return p + LEN_NULL;
+    }
+
+    std::vector<Step>        steps;
+    std::vector<FixedMember> members;
+};
+
+}
@@ -13,9 +13,17 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ******************************************************************/
 #include "sope_encoded_record.h"
+#include "sope_field_index.h"
+#include "sope_projection.h"
+#include "sope_record_def.h"
+#include "sope_record_plan.h"
+#include "sope_table.h"
 
 #include <iostream>
+#include <random>
 #include <stdio.h>
+#include <string.h>
+#include <string>
 #include <vector>
 #include <algorithm>
 
@@ -23,90 +31,6 @@ using namespace sope;
 
 namespace sope_test {
 
-/***************************************
-Definition of FieldDef class
-*****************************************/
-struct FieldDef {
-    Type     type;
-    uint32_t len;
-    bool     asc;
-
-    FieldDef() : type(TYPE_NULL), len(0), asc(true) {}
-    FieldDef(Type t, uint32_t l, bool asc_) : type(t), len(l), asc(asc_) {}
-};
-
-    
-/***************************************
-Definition of RecordDef class
-*****************************************/
-class RecordDef {
-public:
-    RecordDef(int n_fields)
-        : fields(n_fields) {}
-
-    void setFieldDef(int i, Type t, bool asc_) {
-        fields[i] = FieldDef(t, Typelen(t), asc_);
-    }
-
-    Type getType(int i) const {
-        return fields[i].type;
-    }
-
-    uint32_t getLen(int i) const {
-        return fields[i].len;
-    }
-
-    bool isAsc(int i) const {
-        return fields[i].asc;
-    }
-
-    int getNumFields() const {
-        return fields.size();
-    }
-
-private:
-    std::vector<FieldDef> fields;
-};
-
-/***************************************
-Definition of Table class
-*****************************************/
-class Table {
-public:
-    Table(RecordDef* ps) : pSchema(ps) { }
-    ~Table() { delete pSchema; clear(); }
-
-    void clear() {
-        for (int i = 0; i < table.size(); i++) {
-            delete table[i];
-        }
-    }
-
-    void addRecord(EncodedRecord* pr) {
-        table.push_back(pr);
-    }
-
-    EncodedRecord* getRecord(int i) {
-        return (i < table.size()) ? table[i] : nullptr;
-    }
-
-    int getNumRecords() {
-        return table.size();
-    }
-
-    const RecordDef* getSchema() const {
-       return pSchema;
-    }
-
-    void sort() {
-        std::sort(table.begin(), table.end(), comp);
-    }
-
-private:
-    RecordDef* pSchema;
-    std::vector<EncodedRecord*> table;
-};
-
 void displayTable(Table* pt);
 
 void display(EncodedRecord * pr, const RecordDef *ps);
@@ -146,9 +70,13 @@ Table*  buildRecords() {
     RecordDef* ps = create_test_schema();
     Table * pTable = new Table(ps);
 
+    // records are encoded into a growing record, which starts empty and
+    // makes room as the fields are put, then copied into the table
+    EncodedRecord rec;
+    EncodedRecord * pr = &rec;
+    pr->setGrowing();
+
     // record 1
-    EncodedRecord * pr = new EncodedRecord();
-    pr->alloc(100);    // large enough for simplicity
     pr->putNotNullFieldIndicator();
     pr->put(10);
     pr->putNotNullFieldIndicator();
@@ -164,8 +92,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 2
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(100);
     pr->putNotNullFieldIndicator();
@@ -181,8 +107,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 3
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(10);
     pr->putNotNullFieldIndicator();
@@ -198,8 +122,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 4
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(100);
     pr->putNotNullFieldIndicator();
@@ -214,8 +136,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 5
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(100);
     pr->putNotNullFieldIndicator();
@@ -231,8 +151,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 6
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNullFieldIndicator();
     pr->putNullFieldIndicator();
     pr->putNotNullFieldIndicator(false);
@@ -246,8 +164,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 7
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(10);
     pr->putNotNullFieldIndicator();
@@ -263,8 +179,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 8
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(-20);
     pr->putNotNullFieldIndicator();
@@ -279,8 +193,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 9
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(10);
     pr->putNotNullFieldIndicator();
@@ -296,8 +208,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 10
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(-20);
     pr->putNotNullFieldIndicator();
@@ -312,8 +222,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 11
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(10);
     pr->putNotNullFieldIndicator();
@@ -328,8 +236,6 @@ Table*  buildRecords() {
     pTable->addRecord(pr);
 
     // record 12
-    pr = new EncodedRecord();
-    pr->alloc(100);
     pr->putNotNullFieldIndicator();
     pr->put(-20);
     pr->putNotNullFieldIndicator();
@@ -344,9 +250,237 @@ Table*  buildRecords() {
     pr->resetPos();
     pTable->addRecord(pr);
 
+    pr->freeInternals();
     return pTable;
 }
 
+/**********************************
+Checks that every record has the bytes
+of RecordPlan::encode() of its row, in
+calcEncodedLen() bytes
+**********************************/
+bool checkRecordPlan(Table* pt) {
+    const RecordDef* ps = pt->getSchema();
+    RecordPlan plan(ps);
+    std::vector<FieldValue> row(ps->getNumFields());
+    for (int i = 0; i < pt->getNumRecords(); i++) {
+        uint32_t len = pt->getLen(i);
+        std::vector<uint8_t> work(len);
+        if (plan.decode(pt->getData(i), row.data(), work.data()) != len) {
+            return false;
+        }
+        uint32_t enc_len = calcEncodedLen(ps, row.data());
+        std::vector<uint8_t> buf(enc_len);
+        if (enc_len != len || plan.encode(row.data(), buf.data()) != len ||
+            memcmp(buf.data(), pt->getData(i), len) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**********************************
+A schema with every way a field can be
+encoded, and random rows of it: NULLs,
+descending strings and binaries, binaries
+with 0x00 bytes, groups and varints
+**********************************/
+RecordDef* create_mixed_schema() {
+    RecordDef* ps = new RecordDef(10);
+
+    ps->setFieldDef(0, TYPE_INT, true);
+    ps->setFieldDef(1, TYPE_STRING, false);
+    ps->setFieldDef(2, TYPE_BINARY, true);
+    ps->setFieldDef(3, TYPE_BINARY, false);
+    ps->setFieldDef(4, TYPE_DOUBLE, false);
+    ps->setFieldDef(5, TYPE_STRING, true, ENCODING_GROUP);
+    ps->setFieldDef(6, TYPE_BINARY, false, ENCODING_GROUP);
+    ps->setFieldDef(7, TYPE_LONG, true, ENCODING_VARINT);
+    ps->setFieldDef(8, TYPE_TIMESTAMP, false, ENCODING_VARINT);
+    ps->setFieldDef(9, TYPE_INT, false, ENCODING_VARINT);
+
+    return ps;
+}
+
+const char* const MIXED_BYTES[] = {
+    "", "a", "This is a string", "\x00", "\x00\x00", "\x11\x00\xFF", "\xFF\x00",
+    "12345678", "123456789\x00"};
+const uint32_t MIXED_BYTES_LEN[] = {0, 1, 16, 1, 2, 3, 2, 8, 10};
+
+Table* buildMixedRecords(int n) {
+    RecordDef* ps = create_mixed_schema();
+    Table* pTable = new Table(ps);
+    RecordPlan plan(ps);
+    std::mt19937_64 rng(42);
+    std::vector<FieldValue> row(ps->getNumFields());
+    for (int r = 0; r < n; r++) {
+        for (int i = 0; i < ps->getNumFields(); i++) {
+            FieldValue& v = row[i];
+            v = FieldValue();
+            if (rng() % 5 == 0) continue;
+            v.isNull = false;
+            long x = (long)(rng() >> (rng() % 64));
+            int k = rng() % 9;
+            // strings hold no 0x00, the first three entries
+            if (ps->getType(i) == TYPE_STRING) k %= 3;
+            v.ptr = MIXED_BYTES[k];
+            v.len = MIXED_BYTES_LEN[k];
+            switch (ps->getType(i)) {
+            case TYPE_INT:       v.i = (int)x; break;
+            case TYPE_DOUBLE:    v.d = (double)x / 7; break;
+            case TYPE_TIMESTAMP: v.ts = (Timestamp)x; break;
+            default:             v.l = x; break;
+            }
+        }
+        uint32_t len = calcEncodedLen(ps, row.data());
+        pTable->commitRecord(plan.encode(row.data(), pTable->reserveRecord(len)));
+    }
+    return pTable;
+}
+
+// One record decoded field by field with EncodedRecord: the offset of
+// each field, and its value, with strings and binaries copied to bytes
+struct SequentialRecord {
+    std::vector<uint32_t>    offsets;
+    std::vector<FieldValue>  values;
+    std::vector<std::string> bytes;
+};
+
+SequentialRecord decodeSequential(const RecordDef* ps, const uint8_t* data,
+                                  uint32_t len) {
+    SequentialRecord out;
+    int n = ps->getNumFields();
+    out.values.resize(n);
+    out.bytes.resize(n);
+    EncodedRecord rec(const_cast<uint8_t*>(data), len);
+    for (int i = 0; i < n; i++) {
+        const FieldDef& fd = ps->getFieldDef(i);
+        FieldValue& v = out.values[i];
+        out.offsets.push_back(rec.getPos());
+        if (rec.checkNullFieldIndicator(fd.asc)) continue;
+        v.isNull = false;
+        uint32_t l = 0;
+        const void* p = nullptr;
+        if (fd.enc == ENCODING_GROUP) {
+            p = rec.getGroup(l, fd.asc);
+        } else if (fd.enc == ENCODING_VARINT) {
+            switch (fd.type) {
+            case TYPE_INT:       v.i = (int)rec.getVarint(fd.asc); break;
+            case TYPE_TIMESTAMP: v.ts = rec.getUVarint(fd.asc); break;
+            default:             v.l = rec.getVarint(fd.asc); break;
+            }
+        } else {
+            switch (fd.type) {
+            case TYPE_INT:       v.i = rec.getInt(fd.asc); break;
+            case TYPE_LONG:      v.l = rec.getLong(fd.asc); break;
+            case TYPE_DOUBLE:    v.d = rec.getDouble(fd.asc); break;
+            case TYPE_BOOL:      v.b = rec.getBool(fd.asc); break;
+            case TYPE_DATE:      v.l = rec.getDate(fd.asc); break;
+            case TYPE_TIMESTAMP: v.ts = rec.getTimestamp(fd.asc); break;
+            case TYPE_STRING:    p = rec.getString(l, fd.asc); break;
+            case TYPE_BINARY:
+            case TYPE_OBJECT:    p = rec.getBinary(l, fd.asc); break;
+            case TYPE_NULL:      break;
+            }
+        }
+        if (p) out.bytes[i].assign(_RC(const char*, p), l);
+    }
+    out.offsets.push_back(rec.getPos());
+    return out;
+}
+
+bool sameValue(const FieldDef& fd, const FieldValue& v,
+               const FieldValue& ref, const std::string& ref_bytes) {
+    if (v.isNull != ref.isNull) return false;
+    if (v.isNull) return true;
+    switch (fd.type) {
+    case TYPE_INT:       return v.i == ref.i;
+    case TYPE_DOUBLE:    return v.d == ref.d;
+    case TYPE_BOOL:      return v.b == ref.b;
+    case TYPE_TIMESTAMP: return v.ts == ref.ts;
+    case TYPE_STRING:
+    case TYPE_BINARY:
+    case TYPE_OBJECT:
+        return v.len == ref_bytes.size() &&
+               (v.len == 0 || memcmp(v.ptr, ref_bytes.data(), v.len) == 0);
+    case TYPE_NULL:      return true;
+    default:             return v.l == ref.l;
+    }
+}
+
+/**********************************
+Checks FieldIndex::offset() and isNull(),
+asked for in any order, against the
+offsets of a sequential decode
+**********************************/
+bool checkFieldIndex(Table* pt) {
+    const RecordDef* ps = pt->getSchema();
+    int n = ps->getNumFields();
+    FieldIndex idx(ps);
+    for (int r = 0; r < pt->getNumRecords(); r++) {
+        SequentialRecord ref = decodeSequential(ps, pt->getData(r), pt->getLen(r));
+        // from the last field down, then from the first up, then one
+        // field of a fresh reset
+        idx.reset(pt->getData(r));
+        if (idx.endOffset() != pt->getLen(r)) return false;
+        for (int i = n; i-- > 0; ) {
+            if (idx.offset(i) != ref.offsets[i] ||
+                idx.isNull(i) != ref.values[i].isNull) {
+                return false;
+            }
+        }
+        idx.reset(pt->getData(r));
+        for (int i = 0; i < n; i++) {
+            if (idx.offset(i) != ref.offsets[i]) return false;
+        }
+        idx.reset(pt->getData(r));
+        if (idx.offset(r % n) != ref.offsets[r % n]) return false;
+    }
+    return true;
+}
+
+/**********************************
+Checks Projection::decode() with single
+columns, every other column, the last
+column and all of them, against a
+sequential decode
+**********************************/
+bool checkProjection(Table* pt) {
+    const RecordDef* ps = pt->getSchema();
+    int n = ps->getNumFields();
+    int n_recs = pt->getNumRecords();
+    std::vector<SequentialRecord> refs;
+    for (int r = 0; r < n_recs; r++) {
+        refs.push_back(decodeSequential(ps, pt->getData(r), pt->getLen(r)));
+    }
+    std::vector<std::vector<bool> > masks;
+    for (int i = 0; i < n; i++) {
+        masks.push_back(std::vector<bool>(n, false));
+        masks.back()[i] = true;
+    }
+    masks.push_back(std::vector<bool>(n, true));
+    masks.push_back(std::vector<bool>(n, false));
+    for (int i = 0; i < n; i += 2) masks.back()[i] = true;
+    masks.push_back(std::vector<bool>(n, false));
+    for (int i = 1; i < n; i += 2) masks.back()[i] = true;
+    for (const std::vector<bool>& mask : masks) {
+        Projection proj(ps, mask);
+        int cols = proj.getNumColumns();
+        std::vector<FieldValue> out(cols * n_recs);
+        proj.decode(*pt, 0, n_recs, out.data());
+        for (int c = 0; c < cols; c++) {
+            int f = proj.getField(c);
+            for (int r = 0; r < n_recs; r++) {
+                if (!sameValue(ps->getFieldDef(f), out[c * n_recs + r],
+                               refs[r].values[f], refs[r].bytes[f])) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 void display(EncodedRecord * pr, const RecordDef *ps) {
     int i;
     uint32_t len;
@@ -360,13 +494,13 @@ void display(EncodedRecord * pr, const RecordDef *ps) {
         case TYPE_INT:    printf("%d\t", pr->getInt(asc)); break;
         case TYPE_LONG:   printf("%ld\t", pr->getLong(asc)); break;
         case TYPE_DOUBLE: printf("%f\t", pr->getDouble(asc)); break;
-        case TYPE_STRING: { const char* p = pr->getString(len, asc);
+        case TYPE_STRING: { const char* p = pr->getStringView(len, asc);
                             printf("%s\t", std::string(p, len).c_str()); break; }
         case TYPE_BOOL:   printf("%s\t", pr->getBool(asc) ? "true" : "false"); break;
         case TYPE_DATE:   printf("%s\t", toString(pr->getDate(asc)).c_str()); break;
         case TYPE_TIMESTAMP: printf("%s\t", toString(pr->getTimestamp(asc)).c_str()); break;
         case TYPE_BINARY:
-        case TYPE_OBJECT: { uint8_t* p = pr->getBinary(len, asc);
+        case TYPE_OBJECT: { const uint8_t* p = pr->getBinaryView(len, asc);
                             printf("%s\t", toHexString((void*) p, len).c_str());
                             break; }
         case TYPE_NULL:  printf("NULL\t");
@@ -382,8 +516,10 @@ Displays all records of the table
 **********************************/
 void displayTable(Table* pt) {
     const RecordDef* ps = pt->getSchema();
+    EncodedRecord rec;
     for (int i = 0; i < pt->getNumRecords(); i++) {
-        display(pt->getRecord(i), ps);
+        rec.setData(pt->getData(i), pt->getLen(i));
+        display(&rec, ps);
     }
 }
 
@@ -392,7 +528,10 @@ using namespace sope_test;
 
 /************************************************
 Example that:
-a) Builds sample records into a table
+a) Builds sample records into a table, and checks
+   them against RecordPlan::encode(), and checks
+   FieldIndex and Projection against a
+   sequential decode
 b) Displays the table before sort
 c) Sorts the table
 d) Displays the table after sort
@@ -400,6 +539,16 @@ d) Displays the table after sort
 int main(int argc, char** argv)
 {
     Table* pt = buildRecords();
+    bool same = checkRecordPlan(pt);
+    std::cout << "Records as RecordPlan::encode(): " << (same ? "same" : "different") << std::endl;
+
+    Table* pm = buildMixedRecords(500);
+    bool same_index = checkFieldIndex(pt) && checkFieldIndex(pm);
+    std::cout << "FieldIndex as a sequential decode: " << (same_index ? "same" : "different") << std::endl;
+    bool same_proj = checkProjection(pt) && checkProjection(pm);
+    std::cout << "Projection::decode() as a sequential decode: " << (same_proj ? "same" : "different") << std::endl;
+    delete pm;
+    same = same && same_index && same_proj;
     std::cout << "Before sorting:" << std::endl;
     displayTable(pt);
 
@@ -414,6 +563,6 @@ int main(int argc, char** argv)
     //  printf("%s\n", toHexString((void*)pt->getRecord(0)->getData(), pt->getRecord(0)->getLen()).c_str()); 
     delete pt;
 
-    return 0;
+    return same ? 0 : 1;
 }
 
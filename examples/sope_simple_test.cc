@@ -15,11 +15,23 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ******************************************************************/
 
+// sope_key_codec.h brings in sope_types.h, which has to come
+// before sope_encode.h for the Date/Timestamp overloads
+#include "sope_key_codec.h"
 #include "sope_encode.h"
+#include "sope_batch.h"
+#include "sope_record_plan.h"
+#include "sope_table.h"
 
+#include <cfloat>
+#include <climits>
+#include <cmath>
 #include <iostream>
 #include <stdio.h>
 #include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
 
 using namespace sope;
 
@@ -50,6 +62,20 @@ struct EncodedTuple {
     ~EncodedTuple() { }
 };
 
+// the same tuples with the compile-time typed codec
+typedef KeyCodec< Field<int32_t, Asc>,
+                  Field<std::string_view, Asc>,
+                  Field<double, Asc> > TupleCodec;
+
+struct TypedTuple {
+    size_t  len;
+    uint8_t tuple[64];     // for simplicity
+
+    TypedTuple(int ii, const char* str, double dd) {
+        len = TupleCodec::encode(TupleCodec::Tuple(ii, str, dd), tuple);
+    }
+};
+
 #define MIN(x, y) ((x <= y) ? x : y)
 
 // return -1, 0, 1 for t1 < t2, t1==t2, and t1 > t2, respectively
@@ -63,6 +89,482 @@ int compTuple(const EncodedTuple & t1, const EncodedTuple & t2) {
     return rc;
 }
 
+int compTuple(const TypedTuple & t1, const TypedTuple & t2) {
+    int rc = memcmp(t1.tuple, t2.tuple, MIN(t1.len,t2.len));
+    if (rc == 0) {
+        rc = (t1.len < t2.len) ? -1 : ( (t1.len > t2.len) ? 1 : 0 );
+    } else {
+       rc = (rc < 0) ? -1 : 1;
+    }
+    return rc;
+}
+
+/*
+ * Self-checks of the block (SIMD) kernels against the byte-at-a-time
+ * definition of the formats. Values run over lengths 0..80, i.e. past
+ * several 16- and 32-byte blocks, and are placed at every offset from
+ * a 32-byte boundary, so zeros and escapes fall on and across block
+ * edges. Each check prints its number of failures, expected 0.
+ */
+const uint32_t MAX_CHECK_LEN = 80;
+const uint32_t CHECK_OFFSETS = 32;
+const int NUM_PATTERNS = 6;
+
+// value bytes of pattern k: no zeros, all zeros, zeros around 16-byte
+// edges, zeros around 32-byte edges, about 25% zeros at random, and
+// zeros at both ends; 0xFF bytes occur in all but the all-zero one
+void fillPattern(uint8_t* p, uint32_t len, int k) {
+    uint32_t r = 12345;
+    for (uint32_t i = 0; i < len; i++) {
+        uint8_t c = (uint8_t)(1 + (i * 37) % 255);
+        switch (k) {
+        case 1: c = 0; break;
+        case 2: if (i % 16 == 15 || i % 16 == 0) c = 0; break;
+        case 3: if (i % 32 == 31 || i % 32 == 0) c = 0; break;
+        case 4:
+            r = r * 1103515245 + 12345;
+            if ((r >> 16) % 4 == 0) c = 0;
+            break;
+        case 5: if (i == 0 || i == len - 1) c = 0; break;
+        }
+        p[i] = c;
+    }
+}
+
+int report(const char* what, int failures) {
+    printf("%s, expected failures: 0\n%d\n", what, failures);
+    return failures;
+}
+
+// escaped binary, byte by byte
+uint32_t refEncodeBinary(const uint8_t* pb, uint32_t len, uint8_t* out, bool asc) {
+    uint8_t flip = asc ? 0x00 : 0xFF;
+    uint32_t to = 0;
+    for (uint32_t i = 0; i < len; i++) {
+        out[to++] = pb[i] ^ flip;
+        if (pb[i] == 0) out[to++] = 0xFF ^ flip;
+    }
+    out[to++] = flip;
+    out[to++] = flip;
+    return to;
+}
+
+// encode() and calc_binary_encoded_len() of binaries
+int checkBinaryEncode() {
+    int failures = 0;
+    uint8_t raw[MAX_CHECK_LEN];
+    uint8_t expect[2 * MAX_CHECK_LEN + BINARY_PAD_LEN];
+    uint8_t buf[CHECK_OFFSETS + 2 * MAX_CHECK_LEN + BINARY_PAD_LEN];
+    alignas(32) uint8_t src[CHECK_OFFSETS + MAX_CHECK_LEN];
+    for (uint32_t len = 0; len <= MAX_CHECK_LEN; len++) {
+        for (int k = 0; k < NUM_PATTERNS; k++) {
+            fillPattern(raw, len, k);
+            for (int asc = 0; asc < 2; asc++) {
+                uint32_t n = refEncodeBinary(raw, len, expect, asc);
+                for (uint32_t off = 0; off < CHECK_OFFSETS; off++) {
+                    memcpy(src + off, raw, len);
+                    if (calc_binary_encoded_len(src + off, len) != n) failures++;
+                    if (encode((const void*)(src + off), len, buf + off, asc) != n ||
+                        memcmp(buf + off, expect, n) != 0) {
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+// Terminator scans of binaries: get_bytes_len(), get_bytes_encoded_len()
+// and decode_bytes() of the reference encoding, placed at every offset
+// from a 32-byte boundary, so escapes straddle block edges.
+int checkBinaryScan() {
+    int failures = 0;
+    uint8_t raw[MAX_CHECK_LEN];
+    uint8_t enc[2 * MAX_CHECK_LEN + BINARY_PAD_LEN];
+    uint8_t out[2 * MAX_CHECK_LEN + BINARY_PAD_LEN];
+    alignas(32) uint8_t src[CHECK_OFFSETS + sizeof(enc)];
+    for (uint32_t len = 0; len <= MAX_CHECK_LEN; len++) {
+        for (int k = 0; k < NUM_PATTERNS; k++) {
+            fillPattern(raw, len, k);
+            for (int asc = 0; asc < 2; asc++) {
+                uint32_t n = refEncodeBinary(raw, len, enc, asc);
+                for (uint32_t off = 0; off < CHECK_OFFSETS; off++) {
+                    memcpy(src + off, enc, n);
+                    uint32_t dlen = 0;
+                    if (get_bytes_len(src + off, asc) != len) failures++;
+                    if (get_bytes_encoded_len(src + off, asc) != n) failures++;
+                    if (decode_bytes(src + off, out, dlen, asc) != n - BINARY_PAD_LEN ||
+                        dlen != len || memcmp(out, raw, len) != 0) {
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+// Strings: encode() against the definition, then get_string_len() and
+// decode_string() at every offset. A string has no 0x00 pair and does
+// not end with 0x00, so zeros are only kept where both neighbours are
+// not zero.
+int checkStrings() {
+    int failures = 0;
+    uint8_t raw[MAX_CHECK_LEN];
+    uint8_t enc[MAX_CHECK_LEN + STRING_PAD_LEN];
+    uint8_t out[MAX_CHECK_LEN + STRING_PAD_LEN];
+    alignas(32) uint8_t src[CHECK_OFFSETS + sizeof(enc)];
+    for (uint32_t len = 0; len <= MAX_CHECK_LEN; len++) {
+        for (int k = 0; k < NUM_PATTERNS; k++) {
+            fillPattern(raw, len, k);
+            for (uint32_t i = 0; i < len; i++) {
+                if (raw[i] == 0 && (i + 1 == len || raw[i + 1] == 0 ||
+                                    (i > 0 && raw[i - 1] == 0))) {
+                    raw[i] = 'x';
+                }
+            }
+            for (int asc = 0; asc < 2; asc++) {
+                uint8_t flip = asc ? 0x00 : 0xFF;
+                for (uint32_t i = 0; i < len; i++) enc[i] = raw[i] ^ flip;
+                enc[len] = enc[len + 1] = flip;
+                if (encode((const char*)raw, len, out, asc) != len + STRING_PAD_LEN ||
+                    memcmp(out, enc, len + STRING_PAD_LEN) != 0) {
+                    failures++;
+                }
+                for (uint32_t off = 0; off < CHECK_OFFSETS; off++) {
+                    memcpy(src + off, enc, len + STRING_PAD_LEN);
+                    if (get_string_len(src + off, asc) != len) failures++;
+                    if (decode_string(src + off, out, asc) != len ||
+                        memcmp(out, raw, len) != 0) {
+                        failures++;
+                    }
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+// encode_batch() and decode_*_batch() against encode() and decode_*()
+// of each value, for 0 to vals.size() values (past several 4- and
+// 8-value AVX2 groups), into rows wider than a value, at an offset
+// inside them; the bytes around the values must be left alone.
+template <typename T, typename DecodeBatch, typename Decode>
+int checkBatch(const std::vector<T>& vals, DecodeBatch decode_batch, Decode decode) {
+    typedef decltype(encode(T(), true)) E;
+    const size_t stride = 13;
+    const size_t offset = 3;
+    const uint8_t fill = 0xA5;
+    int failures = 0;
+    for (size_t n = 0; n <= vals.size(); n++) {
+        for (int asc = 0; asc < 2; asc++) {
+            std::vector<uint8_t> rows((n + 1) * stride, fill);
+            encode_batch(vals.data(), n, rows.data(), stride, offset, asc);
+            std::vector<T> back(n);
+            decode_batch(rows.data(), stride, offset, n, back.data(), asc);
+            for (size_t i = 0; i < rows.size(); i++) {
+                size_t in_row = i % stride;
+                bool value = i / stride < n && in_row >= offset &&
+                             in_row < offset + sizeof(E);
+                if (!value && rows[i] != fill) failures++;
+            }
+            for (size_t i = 0; i < n; i++) {
+                E e = encode(vals[i], asc);
+                E got;
+                memcpy(&got, &rows[i * stride + offset], sizeof(E));
+                if (got != e) failures++;
+                T v = decode(&got, asc);
+                // compare bits: NaN != NaN
+                if (memcmp(&v, &vals[i], sizeof(T)) != 0 ||
+                    memcmp(&back[i], &vals[i], sizeof(T)) != 0) {
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+// 40 values of each type: the edges, then pseudo-random ones
+template <typename T>
+std::vector<T> batchValues(std::vector<T> vals) {
+    uint64_t r = 88172645463325252ULL;
+    while (vals.size() < 40) {
+        r ^= r << 13;
+        r ^= r >> 7;
+        r ^= r << 17;
+        T v;
+        memcpy(&v, &r, sizeof(T));
+        vals.push_back(v);
+    }
+    return vals;
+}
+
+int checkBatches() {
+    int failures = 0;
+    failures += checkBatch(batchValues<int>({0, 1, -1, INT_MIN, INT_MAX}),
+        [](const void* p, size_t st, size_t off, size_t n, int* col, bool asc) {
+            decode_int_batch(p, st, off, n, col, asc);
+        },
+        [](const void* p, bool asc) { return decode_int(p, asc); });
+    failures += checkBatch(batchValues<long>({0, 1, -1, LONG_MIN, LONG_MAX}),
+        [](const void* p, size_t st, size_t off, size_t n, long* col, bool asc) {
+            decode_long_batch(p, st, off, n, col, asc);
+        },
+        [](const void* p, bool asc) { return decode_long(p, asc); });
+    failures += checkBatch(batchValues<double>({0.0, -0.0, 1.5, -1.5, DBL_MAX,
+                                               -DBL_MAX, DBL_MIN, -DBL_MIN,
+                                               HUGE_VAL, -HUGE_VAL}),
+        [](const void* p, size_t st, size_t off, size_t n, double* col, bool asc) {
+            decode_double_batch(p, st, off, n, col, asc);
+        },
+        [](const void* p, bool asc) { return decode_double(p, asc); });
+    failures += checkBatch(batchValues<Date>({0, -86400000, 1546300800000}),
+        [](const void* p, size_t st, size_t off, size_t n, Date* col, bool asc) {
+            decode_date_batch(p, st, off, n, col, asc);
+        },
+        [](const void* p, bool asc) { return decode_date(p, asc); });
+    failures += checkBatch(batchValues<Timestamp>({0, 1, ULLONG_MAX}),
+        [](const void* p, size_t st, size_t off, size_t n, Timestamp* col, bool asc) {
+            decode_timestamp_batch(p, st, off, n, col, asc);
+        },
+        [](const void* p, bool asc) { return decode_timestamp(p, asc); });
+    return failures;
+}
+
+// <0, 0, >0 as memcmp, then the shorter first
+int compareBytes(const void* a, size_t a_len, const void* b, size_t b_len) {
+    int c = memcmp(a, b, std::min(a_len, b_len));
+    if (c != 0) return c;
+    return (a_len < b_len) ? -1 : (a_len > b_len);
+}
+
+int sign(int c) { return (c > 0) - (c < 0); }
+
+// Fixed groups: encode_group(), get_group_encoded_len() and
+// decode_group() round trips at lengths around a group, with and
+// without 0x00 bytes, and the order of the encodings of values that
+// are prefixes of one another.
+int checkGroups() {
+    int failures = 0;
+    const uint32_t lens[] = {0, 1, 7, 8, 9, 15, 16, 17, 24};
+    uint8_t raw[24];
+    uint8_t enc[27];
+    uint8_t out[24];
+    for (uint32_t len : lens) {
+        for (int k = 0; k < NUM_PATTERNS; k++) {
+            fillPattern(raw, len, k);
+            for (int asc = 0; asc < 2; asc++) {
+                uint32_t n = calc_group_encoded_len(len);
+                if (encode_group(raw, len, enc, asc) != n) failures++;
+                if (get_group_encoded_len(enc, asc) != n) failures++;
+                uint32_t out_len = ~0U;
+                if (decode_group(enc, out, out_len, asc) != n ||
+                    out_len != len || memcmp(out, raw, len) != 0) {
+                    failures++;
+                }
+            }
+        }
+    }
+    const std::string vals[] = {
+        std::string(), std::string(1, '\0'), std::string(2, '\0'),
+        "abc", std::string("abc\0", 4), std::string("abc\0\0", 5),
+        "abcdefg", std::string("abcdefg\0", 8), "abcdefgh",
+        std::string("abcdefgh\0", 9), "abcdefghi", "abcdefghijklmnop",
+        std::string("abcdefghijklmnop\0", 17), "abd", "b"
+    };
+    for (const std::string& a : vals) {
+        for (const std::string& b : vals) {
+            int expect = sign(a.compare(b));
+            for (int asc = 0; asc < 2; asc++) {
+                uint8_t ea[27], eb[27];
+                uint32_t na = encode_group(a.data(), a.size(), ea, asc);
+                uint32_t nb = encode_group(b.data(), b.size(), eb, asc);
+                if (sign(compareBytes(ea, na, eb, nb)) != (asc ? expect : -expect)) {
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+// Varints: the bytes of a few values as documented, round trips and
+// lengths at the edges of each byte count and of int and long, and the
+// order of every pair of values, in both orders.
+int checkVarints() {
+    int failures = 0;
+    struct { long v; uint8_t n; uint8_t bytes[3]; } known[] = {
+        {0, 1, {0x80}}, {1, 2, {0x81, 0x01}}, {300, 3, {0x82, 0x01, 0x2C}},
+        {-1, 1, {0x7F}}, {-2, 2, {0x7E, 0xFE}}
+    };
+    uint8_t enc[VARINT_MAX_LEN], enc2[VARINT_MAX_LEN];
+    for (const auto& e : known) {
+        if (encode_varint(e.v, enc, true) != e.n ||
+            memcmp(enc, e.bytes, e.n) != 0) {
+            failures++;
+        }
+    }
+    const long vals[] = {
+        LONG_MIN, (long)INT_MIN - 1, INT_MIN, -65537, -65536, -257, -256,
+        -255, -2, -1, 0, 1, 2, 255, 256, 65535, 65536, INT_MAX,
+        (long)INT_MAX + 1, LONG_MAX
+    };
+    for (long v : vals) {
+        for (int asc = 0; asc < 2; asc++) {
+            uint32_t n = encode_varint(v, enc, asc);
+            if (n != calc_varint_encoded_len(v) || n > VARINT_MAX_LEN ||
+                get_varint_encoded_len(enc, asc) != n) {
+                failures++;
+            }
+            long l = ~v;
+            if (decode_varint(enc, l, asc) != n || l != v) failures++;
+            if (v >= INT_MIN && v <= INT_MAX) {
+                // int encodes as the same long
+                int i = ~(int)v;
+                if (encode_varint((int)v, enc2, asc) != n ||
+                    memcmp(enc, enc2, n) != 0 ||
+                    decode_varint(enc, i, asc) != n || i != v) {
+                    failures++;
+                }
+            }
+        }
+    }
+    for (long a : vals) {
+        for (long b : vals) {
+            int expect = (a > b) - (a < b);
+            for (int asc = 0; asc < 2; asc++) {
+                uint32_t na = encode_varint(a, enc, asc);
+                uint32_t nb = encode_varint(b, enc2, asc);
+                if (sign(compareBytes(enc, na, enc2, nb)) != (asc ? expect : -expect)) {
+                    failures++;
+                }
+            }
+        }
+    }
+    const uint64_t uvals[] = {
+        0, 1, 2, 255, 256, 65535, 65536, INT_MAX, (uint64_t)LONG_MAX,
+        (uint64_t)LONG_MAX + 1, UINT64_MAX - 1, UINT64_MAX
+    };
+    for (uint64_t a : uvals) {
+        for (int asc = 0; asc < 2; asc++) {
+            uint32_t n = encode_uvarint(a, enc, asc);
+            uint64_t u = ~a;
+            if (n != calc_uvarint_encoded_len(a) || n > VARINT_MAX_LEN ||
+                get_varint_encoded_len(enc, asc) != n ||
+                decode_uvarint(enc, u, asc) != n || u != a) {
+                failures++;
+            }
+            for (uint64_t b : uvals) {
+                int expect = (a > b) - (a < b);
+                uint32_t nb = encode_uvarint(b, enc2, asc);
+                if (sign(compareBytes(enc, n, enc2, nb)) != (asc ? expect : -expect)) {
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+// RecordPlan rows with varint fields of each type and order, and
+// NULLs: encode() into calcEncodedLen() bytes, then decode()
+int checkVarintPlan() {
+    int failures = 0;
+    sope_test::RecordDef* ps = new sope_test::RecordDef(5);
+    ps->setFieldDef(0, TYPE_INT, true, ENCODING_VARINT);
+    ps->setFieldDef(1, TYPE_LONG, false, ENCODING_VARINT);
+    ps->setFieldDef(2, TYPE_DATE, true, ENCODING_VARINT);
+    ps->setFieldDef(3, TYPE_TIMESTAMP, false, ENCODING_VARINT);
+    ps->setFieldDef(4, TYPE_INT, true);
+    sope_test::RecordPlan plan(ps);
+    const long vals[] = {0, 1, -1, -257, 256, INT_MIN, INT_MAX, LONG_MIN, LONG_MAX};
+    uint8_t buf[5 * (LEN_NULL + VARINT_MAX_LEN)];
+    for (size_t r = 0; r < sizeof(vals) / sizeof(vals[0]); r++) {
+        sope_test::FieldValue row[5], back[5];
+        long v = vals[r];
+        row[0].isNull = false;
+        row[0].i = (int)v;
+        row[1].isNull = (r % 3 == 1);
+        row[1].l = v;
+        row[2].isNull = false;
+        row[2].l = ~v;
+        row[3].isNull = (r % 3 == 2);
+        row[3].ts = (Timestamp)v;
+        row[4].isNull = false;
+        row[4].i = (int)r;
+        uint32_t len = sope_test::calcEncodedLen(ps, row);
+        if (len > sizeof(buf) || plan.encode(row, buf) != len) {
+            failures++;
+            continue;
+        }
+        if (plan.decode(buf, back, nullptr) != len) failures++;
+        for (int f = 0; f < 5; f++) {
+            if (back[f].isNull != row[f].isNull) failures++;
+        }
+        if (back[0].i != row[0].i || back[2].l != row[2].l || back[4].i != row[4].i ||
+            (!row[1].isNull && back[1].l != row[1].l) ||
+            (!row[3].isNull && back[3].ts != row[3].ts)) {
+            failures++;
+        }
+    }
+    delete ps;
+    return failures;
+}
+
+#if defined(SOPE_STATS)
+// SOPE_STATS counters of known values, and their path from the
+// thread's counters through flush() to the totals
+int checkStats() {
+    int failures = 0;
+    stats::flush();
+    stats::resetFlushed();
+    uint8_t buf[64];
+    const uint8_t bin[] = {0, 1, 0, 2};
+    encode((const void*)bin, 4, buf, true);
+    decode_int(buf, true);
+    encode_varint(300L, buf, true);
+    sope_test::Table t(new sope_test::RecordDef(1));
+    const uint32_t key_lens[] = {0, 5, 6, 100};
+    for (uint32_t len : key_lens) {
+        t.reserveRecord(len);
+        t.commitRecord(len);
+    }
+
+    stats::Stats s = stats::snapshot();
+    if (s.encodedValues[stats::KIND_BINARY] != 1 ||
+        s.encodedBytes[stats::KIND_BINARY] != 4 + 2 + BINARY_PAD_LEN) failures++;
+    if (s.binaryBytes != 4 || s.binaryEscapes != 2) failures++;
+    if (s.escapeFraction() != 0.5) failures++;
+    if (s.decodedValues[stats::KIND_INT] != 1 ||
+        s.decodedBytes[stats::KIND_INT] != 4) failures++;
+    if (s.encodedValues[stats::KIND_VARINT] != 1 ||
+        s.encodedBytes[stats::KIND_VARINT] != 3) failures++;
+    // buckets: 0 | [4, 8) | [64, 128)
+    if (s.keyCount != 4 || s.keyBytes != 111) failures++;
+    if (s.keyLenBuckets[0] != 1 || s.keyLenBuckets[3] != 2 ||
+        s.keyLenBuckets[7] != 1) failures++;
+    if (s.keyLenQuantile(0) != 0 || s.keyLenQuantile(0.5) != 7 ||
+        s.keyLenQuantile(1) != 127) failures++;
+    if (stats::flushed().keyCount != 0) failures++;
+
+    stats::flush();
+    if (stats::snapshot().keyCount != 0) failures++;
+    std::thread th([]() {
+        encode(1, true);
+        stats::flush();
+    });
+    th.join();
+    stats::Stats g = stats::flushed();
+    if (g.keyCount != 4 || g.keyLenBuckets[3] != 2 || g.binaryEscapes != 2) failures++;
+    if (g.encodedValues[stats::KIND_INT] != 1) failures++;
+    stats::resetFlushed();
+    if (stats::flushed().keyCount != 0) failures++;
+    return failures;
+}
+#endif
+
 int main(int argc, char** argv)
 {
     EncodedTuple tuple1(10, "This is a string", 1234.5678),
@@ -94,6 +596,39 @@ int main(int argc, char** argv)
     rc = compTuple(tuple1, tuple7);
     printf("%d\n", rc);
 
-    return 0;
+    TypedTuple typed1(10, "This is a string", 1234.5678),
+               typed2(-10, "This is a string", 12345.6789),
+               typed3(100, "This is a string", 1234.5678),
+               typed4(10, "This is a string1", 1234.5678),
+               typed5(10, "This is a strin", 1234.5678),
+               typed6(10, "This is a string", -1234.5678),
+               typed7(10, "This is a string", 1234.5678);
+
+    printf("%d %d %d %d %d %d\n",
+           compTuple(typed1, typed2), compTuple(typed1, typed3),
+           compTuple(typed1, typed4), compTuple(typed1, typed5),
+           compTuple(typed1, typed6), compTuple(typed1, typed7));
+
+    // decode back into a tuple; fields of the fixed-width prefix
+    // can also be read in place
+    TupleCodec::Tuple t;
+    TupleCodec::decode(typed4.tuple, t);
+    printf("%d \"%.*s\" %.4f, int field: %d\n", std::get<0>(t),
+           (int)std::get<1>(t).size(), std::get<1>(t).data(), std::get<2>(t),
+           TupleCodec::get<0>(typed4.tuple));
+
+    int failures = 0;
+    failures += report("Binary escaping over block edges", checkBinaryEncode());
+    failures += report("Binary scans over block edges", checkBinaryScan());
+    failures += report("String scans over block edges", checkStrings());
+    failures += report("Batch encode/decode against single values", checkBatches());
+    failures += report("Group encoding round trips and order", checkGroups());
+    failures += report("Varint round trips and order", checkVarints());
+    failures += report("RecordPlan varint fields", checkVarintPlan());
+#if defined(SOPE_STATS)
+    failures += report("Stats of known values", checkStats());
+#endif
+
+    return failures ? 1 : 0;
 }
 
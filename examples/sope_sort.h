@@ -0,0 +1,378 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <thread>
+#include <vector>
+
+namespace sope {
+
+/**
+ * Sort engines for encoded records.
+ *
+ * Encoded records order by their bytes, [0, getEndPos()). All the
+ * engines here use plain lexicographic order: memcmp over the common
+ * length, then the shorter key first. For records of one schema no
+ * key is a prefix of another (every field is self-delimited), so this
+ * is the same order as comp().
+ *
+ * The engines are templates over the element type T being sorted and
+ * a KeyOf functor that returns the key of an element as a KeyRef, so
+ * that they sort EncodedRecord* (RecordKeys) as well as handles into
+ * a RecordArena (ArenaKeys in sope_record_arena.h).
+ */
+
+enum SortMethod {
+    SORT_COMPARE,   // std::sort with a key comparison, as comp()
+    SORT_PREFIX,    // prefix_sort()
+    SORT_RADIX,     // radix_sort()
+    SORT_PARALLEL   // parallel_sort()
+};
+
+struct KeyRef {
+    const uint8_t* data;
+    uint32_t       len;
+};
+
+struct RecordKeys {
+    KeyRef operator()(const EncodedRecord* pr) const {
+        return KeyRef{_RC(const uint8_t*, pr->getData()),
+                      (uint32_t)pr->getEndPos()};
+    }
+};
+
+// <0, 0, >0 as memcmp, comparing from byte `from` on
+// (the first `from` bytes of both keys are known to be equal)
+inline int compareKeys(KeyRef k1, KeyRef k2, uint32_t from = 0) {
+    uint32_t len = (k1.len <= k2.len) ? k1.len : k2.len;
+    // an empty key may have no data at all
+    int c = (len > from) ? memcmp(k1.data + from, k2.data + from, len - from) : 0;
+    if (c != 0) return c;
+    return (k1.len < k2.len) ? -1 : (k1.len > k2.len);
+}
+
+inline int compareKeys(const EncodedRecord* r1, const EncodedRecord* r2,
+                       uint32_t from = 0) {
+    return compareKeys(RecordKeys()(r1), RecordKeys()(r2), from);
+}
+
+inline bool keyLess(const EncodedRecord* r1, const EncodedRecord* r2) {
+    return compareKeys(r1, r2) < 0;
+}
+
+/**
+ * Abbreviated key sort.
+ *
+ * std::sort over EncodedRecord* with comp() reads two records and then
+ * their two data buffers on every comparison. Here the first 8 key
+ * bytes are loaded once per record as a big-endian integer, and a
+ * dense array of {prefix, index of the record} is sorted instead.
+ * Only equal prefixes go to the key bytes, through the record. With
+ * an INT or LONG leading column the prefix holds the indicator and
+ * most of the value, so nearly all comparisons are one integer compare
+ * within the array.
+ */
+const uint32_t KEY_PREFIX_LEN = 8;
+
+// first 8 key bytes, big-endian, zero padded
+inline uint64_t keyPrefix(KeyRef k) {
+    uint64_t v = 0;
+    if (k.len) memcpy(&v, k.data, (k.len < KEY_PREFIX_LEN) ? k.len : KEY_PREFIX_LEN);
+    return _dec64(v);
+}
+
+// 16 bytes: the prefix and the position of the element in the input
+struct PrefixEntry {
+    uint64_t prefix;
+    size_t   index;
+};
+
+template <typename T, typename KeyOf>
+void prefix_sort(std::vector<T>& recs, KeyOf keyOf) {
+    std::vector<PrefixEntry> keys(recs.size());
+    for (size_t i = 0; i < recs.size(); i++) {
+        keys[i].prefix = keyPrefix(keyOf(recs[i]));
+        keys[i].index = i;
+    }
+    std::sort(keys.begin(), keys.end(),
+              [&recs, keyOf](const PrefixEntry& a, const PrefixEntry& b) {
+                  if (a.prefix != b.prefix) return a.prefix < b.prefix;
+                  // equal prefixes: the first min(8, len) bytes are equal
+                  KeyRef ka = keyOf(recs[a.index]);
+                  KeyRef kb = keyOf(recs[b.index]);
+                  uint32_t from = std::min(std::min(ka.len, kb.len),
+                                           KEY_PREFIX_LEN);
+                  return compareKeys(ka, kb, from) < 0;
+              });
+    std::vector<T> sorted;
+    sorted.reserve(recs.size());
+    for (const PrefixEntry& e : keys) sorted.push_back(recs[e.index]);
+    recs.swap(sorted);
+}
+
+inline void prefix_sort(std::vector<EncodedRecord*>& recs) {
+    prefix_sort(recs, RecordKeys());
+}
+
+/**
+ * MSD radix sort (American flag sort) over the key bytes.
+ *
+ * Each pass distributes a range into 257 buckets by the key byte at
+ * `depth`: bucket 0 holds the keys that end before `depth` (they sort
+ * first and are all equal), bucket 1 + b the keys with byte b. The
+ * permutation is done in place. The bytes of the current pass are
+ * read once into `digits` and moved along with the records, so each
+ * record is dereferenced once per pass.
+ *
+ * - Buckets of up to RADIX_COMPARE_MAX keys are finished with a
+ *   comparison sort from `depth` on (an insertion sort for the
+ *   smallest), where a 257-way pass costs more than it saves.
+ * - Ranges whose keys share the byte skip the whole prefix they have
+ *   in common, found with one comparison per key, so long common key
+ *   parts (long strings, many equal keys) do not cost a pass per byte.
+ */
+const size_t   RADIX_INSERTION_MAX = 32;
+const size_t   RADIX_COMPARE_MAX = 256;
+const uint32_t RADIX_BUCKETS = 257;
+
+inline uint16_t keyDigit(KeyRef k, uint32_t depth) {
+    return (depth < k.len) ? k.data[depth] + 1 : 0;
+}
+
+template <typename T, typename KeyOf>
+void insertion_sort(T* recs, size_t n, uint32_t depth, KeyOf keyOf) {
+    for (size_t i = 1; i < n; i++) {
+        T rec = recs[i];
+        KeyRef key = keyOf(rec);
+        size_t j = i;
+        for (; j > 0 && compareKeys(key, keyOf(recs[j - 1]), depth) < 0; j--) {
+            recs[j] = recs[j - 1];
+        }
+        recs[j] = rec;
+    }
+}
+
+// end of the prefix that all the keys share, known to be at least
+// depth long
+template <typename T, typename KeyOf>
+uint32_t commonPrefix(const T* recs, size_t n, uint32_t depth, KeyOf keyOf) {
+    KeyRef first = keyOf(recs[0]);
+    uint32_t end = first.len;
+    for (size_t i = 1; i < n && end > depth; i++) {
+        KeyRef k = keyOf(recs[i]);
+        if (k.len < end) end = k.len;
+        uint32_t j = depth;
+        while (j < end && k.data[j] == first.data[j]) j++;
+        end = j;
+    }
+    return end > depth ? end : depth;
+}
+
+template <typename T, typename KeyOf>
+void radix_sort(T* recs, uint16_t* digits, size_t n, uint32_t depth,
+                KeyOf keyOf) {
+    for (;;) {
+        if (n <= RADIX_INSERTION_MAX) {
+            insertion_sort(recs, n, depth, keyOf);
+            return;
+        }
+        if (n <= RADIX_COMPARE_MAX) {
+            std::sort(recs, recs + n, [depth, keyOf](const T& r1, const T& r2) {
+                return compareKeys(keyOf(r1), keyOf(r2), depth) < 0;
+            });
+            return;
+        }
+
+        size_t count[RADIX_BUCKETS] = {0};
+        for (size_t i = 0; i < n; i++) {
+            digits[i] = keyDigit(keyOf(recs[i]), depth);
+            count[digits[i]]++;
+        }
+        if (count[digits[0]] == n) {
+            // a single bucket: skip the prefix all the keys share
+            if (digits[0] == 0) return;
+            depth = commonPrefix(recs, n, depth + 1, keyOf);
+            continue;
+        }
+
+        size_t start[RADIX_BUCKETS], next[RADIX_BUCKETS];
+        size_t pos = 0;
+        for (uint32_t b = 0; b < RADIX_BUCKETS; b++) {
+            start[b] = next[b] = pos;
+            pos += count[b];
+        }
+        for (uint32_t b = 0; b < RADIX_BUCKETS; b++) {
+            size_t end = start[b] + count[b];
+            while (next[b] < end) {
+                size_t i = next[b];
+                uint16_t d = digits[i];
+                if (d == b) {
+                    next[b]++;
+                    continue;
+                }
+                // move recs[i] to its bucket, take that slot's record
+                size_t j = next[d]++;
+                std::swap(recs[i], recs[j]);
+                std::swap(digits[i], digits[j]);
+            }
+        }
+
+        // bucket 0: keys ended, all equal
+        for (uint32_t b = 1; b < RADIX_BUCKETS; b++) {
+            if (count[b] > 1) {
+                radix_sort(recs + start[b], digits + start[b], count[b],
+                           depth + 1, keyOf);
+            }
+        }
+        return;
+    }
+}
+
+template <typename T, typename KeyOf>
+void radix_sort(std::vector<T>& recs, KeyOf keyOf) {
+    std::vector<uint16_t> digits(recs.size());
+    radix_sort(recs.data(), digits.data(), recs.size(), 0, keyOf);
+}
+
+inline void radix_sort(std::vector<EncodedRecord*>& recs) {
+    radix_sort(recs, RecordKeys());
+}
+
+/**
+ * Parallel sample sort.
+ *
+ * 1. Splitters are taken from a regular sample of the keys, so that
+ *    they cut the input into PARALLEL_BUCKETS_PER_THREAD buckets per
+ *    thread of about the same size.
+ * 2. Each thread finds the bucket of every record of its part of the
+ *    input (binary search over the splitters, by key).
+ * 3. Each thread copies its records to their buckets, at offsets
+ *    given by the prefix sums of the per-thread bucket counts.
+ * 4. Threads take buckets one at a time and radix_sort() them.
+ *
+ * Buckets are ordered by key and every record goes to the bucket of
+ * its key, so the result is the same key order as the single-threaded
+ * engines. Records with byte-identical keys may come out in a
+ * different relative order, as with any of the unstable engines.
+ *
+ * n_threads <= 0 uses std::thread::hardware_concurrency(). More
+ * threads than 4 per hardware thread, or than PARALLEL_MAX_THREADS,
+ * are not started.
+ */
+const size_t PARALLEL_MIN_RECORDS = 1 << 16;
+const size_t PARALLEL_BUCKETS_PER_THREAD = 4;
+const size_t PARALLEL_OVERSAMPLE = 32;
+const size_t PARALLEL_MAX_THREADS = 1024;
+
+// bucket ids are uint16_t
+static_assert(PARALLEL_MAX_THREADS * PARALLEL_BUCKETS_PER_THREAD <= (1 << 16),
+              "too many buckets for 16-bit bucket ids");
+
+// Runs fn(t) for t in [0, n_threads), the last one on this thread.
+template <typename Fn>
+void run_threads(int n_threads, Fn fn) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads - 1; t++) {
+        threads.emplace_back(fn, t);
+    }
+    fn(n_threads - 1);
+    for (std::thread& th : threads) th.join();
+}
+
+template <typename T, typename KeyOf>
+void parallel_sort(std::vector<T>& recs, int n_threads, KeyOf keyOf) {
+    unsigned hw = std::max(1U, std::thread::hardware_concurrency());
+    if (n_threads <= 0) n_threads = hw;
+    n_threads = (int)std::min({(size_t)n_threads, (size_t)hw * 4,
+                               PARALLEL_MAX_THREADS});
+    const size_t n = recs.size();
+    if (n_threads == 1 || n < PARALLEL_MIN_RECORDS) {
+        radix_sort(recs, keyOf);
+        return;
+    }
+    // at least one record per sample slot
+    n_threads = (int)std::min((size_t)n_threads,
+            n / (PARALLEL_BUCKETS_PER_THREAD * PARALLEL_OVERSAMPLE));
+
+    // 1. splitters
+    const size_t n_buckets = n_threads * PARALLEL_BUCKETS_PER_THREAD;
+    assert(n_buckets <= (1 << 16));
+    auto less = [](KeyRef k1, KeyRef k2) { return compareKeys(k1, k2) < 0; };
+    std::vector<KeyRef> sample(n_buckets * PARALLEL_OVERSAMPLE);
+    for (size_t i = 0; i < sample.size(); i++) {
+        sample[i] = keyOf(recs[i * (n / sample.size())]);
+    }
+    std::sort(sample.begin(), sample.end(), less);
+    std::vector<KeyRef> splitters(n_buckets - 1);
+    for (size_t b = 0; b < splitters.size(); b++) {
+        splitters[b] = sample[(b + 1) * PARALLEL_OVERSAMPLE];
+    }
+
+    // 2. bucket of every record, counts per thread and bucket
+    std::vector<uint16_t> ids(n);
+    std::vector<size_t> counts(n_threads * n_buckets, 0);
+    auto part = [n, n_threads](int t) { return n * t / n_threads; };
+    run_threads(n_threads, [&](int t) {
+        size_t* cnt = &counts[t * n_buckets];
+        for (size_t i = part(t); i < part(t + 1); i++) {
+            ids[i] = std::upper_bound(splitters.begin(), splitters.end(),
+                                      keyOf(recs[i]), less)
+                     - splitters.begin();
+            cnt[ids[i]]++;
+        }
+    });
+
+    // 3. scatter, bucket by bucket and within a bucket by thread
+    std::vector<size_t> bucketStart(n_buckets + 1);
+    size_t pos = 0;
+    for (size_t b = 0; b < n_buckets; b++) {
+        bucketStart[b] = pos;
+        for (int t = 0; t < n_threads; t++) {
+            size_t c = counts[t * n_buckets + b];
+            counts[t * n_buckets + b] = pos;
+            pos += c;
+        }
+    }
+    bucketStart[n_buckets] = n;
+    std::vector<T> out(n);
+    run_threads(n_threads, [&](int t) {
+        size_t* next = &counts[t * n_buckets];
+        for (size_t i = part(t); i < part(t + 1); i++) {
+            out[next[ids[i]]++] = recs[i];
+        }
+    });
+
+    // 4. sort the buckets, ids is reused for the radix digits
+    std::atomic<size_t> nextBucket(0);
+    run_threads(n_threads, [&](int) {
+        for (size_t b; (b = nextBucket++) < n_buckets; ) {
+            size_t first = bucketStart[b];
+            radix_sort(out.data() + first, ids.data() + first,
+                       bucketStart[b + 1] - first, 0, keyOf);
+        }
+    });
+    recs.swap(out);
+}
+
+inline void parallel_sort(std::vector<EncodedRecord*>& recs, int n_threads) {
+    parallel_sort(recs, n_threads, RecordKeys());
+}
+
+}
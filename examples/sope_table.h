@@ -0,0 +1,115 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encoded_record.h"
+#include "sope_record_arena.h"
+#include "sope_record_def.h"
+#include "sope_sort.h"
+
+#include <vector>
+#include <algorithm>
+
+namespace sope_test {
+
+/***************************************
+Definition of Table class:
+the encoded records are kept in a
+RecordArena, the table is the list of
+their handles.
+*****************************************/
+class Table {
+public:
+    Table(RecordDef* ps) : pSchema(ps) { }
+    ~Table() { delete pSchema; }
+
+    // drops all records at once
+    void clear() {
+        table.clear();
+        arena.clear();
+    }
+
+    // copies the record [0, getEndPos()) into the arena; false if out
+    // of memory
+    bool addRecord(const EncodedRecord* pr) {
+        RecordHandle h;
+        if (!arena.append(pr, h)) return false;
+        table.push_back(h);
+        SOPE_STAT_KEY(pr->getEndPos());
+        return true;
+    }
+
+    // record encoded in place: reserve space for up to max_len bytes
+    // (null if out of memory), encode it there, then commit its length
+    uint8_t* reserveRecord(uint32_t max_len) {
+        return arena.reserve(max_len);
+    }
+
+    void commitRecord(uint32_t len) {
+        table.push_back(arena.commit(len));
+        SOPE_STAT_KEY(len);
+    }
+
+    RecordHandle getHandle(int i) const {
+        return table[i];
+    }
+
+    uint8_t* getData(int i) {
+        return arena.getData(table[i]);
+    }
+
+    const uint8_t* getData(int i) const {
+        return arena.getData(table[i]);
+    }
+
+    uint32_t getLen(int i) const {
+        return table[i].len;
+    }
+
+    const RecordArena& getArena() const {
+        return arena;
+    }
+
+    int getNumRecords() const {
+        return table.size();
+    }
+
+    const RecordDef* getSchema() const {
+       return pSchema;
+    }
+
+    // n_threads is used by SORT_PARALLEL only, 0 for one per core
+    void sort(SortMethod method = SORT_COMPARE, int n_threads = 0) {
+        ArenaKeys keys = { &arena };
+        switch (method) {
+        case SORT_COMPARE:
+            std::sort(table.begin(), table.end(),
+                      [keys](const RecordHandle& h1, const RecordHandle& h2) {
+                          return compareKeys(keys(h1), keys(h2)) < 0;
+                      });
+            break;
+        case SORT_PREFIX:   prefix_sort(table, keys); break;
+        case SORT_RADIX:    radix_sort(table, keys); break;
+        case SORT_PARALLEL: parallel_sort(table, n_threads, keys); break;
+        }
+    }
+
+private:
+    RecordDef* pSchema;
+    RecordArena arena;
+    std::vector<RecordHandle> table;
+};
+
+}
@@ -0,0 +1,816 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#include "sope_external_sort.h"
+#include "sope_key_block.h"
+#include "sope_key_index.h"
+#include "sope_prefix_bloom.h"
+#include "sope_prefix_index.h"
+#include "sope_range_scan.h"
+#include "sope_record_arena.h"
+#include "sope_record_def.h"
+#include "sope_record_plan.h"
+#include "sope_sort.h"
+#include "sope_table.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace sope;
+using namespace sope_test;
+
+/************************************************
+Self-checks of the table-level examples: the sort
+engines and the structures built over sorted
+tables, each against a plain reference (std::sort,
+std::lower_bound, a filtered full scan). Keys are
+raw byte strings, the engines only compare bytes.
+Each check prints its number of failures,
+expected 0.
+**************************************************/
+
+namespace {
+
+int report(const char* what, int failures) {
+    printf("%s, expected failures: 0\n%d\n", what, failures);
+    return failures;
+}
+
+// xorshift, so the keys are the same on every run
+struct Rng {
+    uint64_t s = 88172645463325252ULL;
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+    uint32_t below(uint32_t n) { return (uint32_t)(next() % n); }
+};
+
+KeyRef keyRef(const std::string& k) {
+    return KeyRef{(const uint8_t*)k.data(), (uint32_t)k.size()};
+}
+
+// RecordArena with 256-byte chunks: records of every length up to
+// past a chunk, empty ones at the end of a full chunk, and large ones
+// reserved and dropped without commit, read back through their handles;
+// then clear() keeps only the chunks, which the same records reuse.
+int checkArena() {
+    int failures = 0;
+    RecordArena arena(8);
+    std::vector<RecordHandle> handles;
+    std::vector<std::string> recs;
+    Rng rng;
+    size_t after_first = 0;
+    for (int round = 0; round < 2; round++) {
+        rng = Rng();
+        handles.clear();
+        recs.clear();
+        for (int i = 0; i < 2000; i++) {
+            uint32_t len = rng.below(8) ? rng.below(64) : rng.below(600);
+            if (i % 97 == 0) len = 256 - 1;
+            if (i % 97 == 1) len = 0;
+            if (i % 13 == 0) arena.reserve(300 + rng.below(300));
+            std::string rec;
+            for (uint32_t j = 0; j < len; j++) rec += (char)rng.next();
+            RecordHandle h;
+            if (!arena.append(rec.data(), len, h)) failures++;
+            handles.push_back(h);
+            recs.push_back(rec);
+        }
+        for (size_t i = 0; i < recs.size(); i++) {
+            KeyRef k = arena.getKey(handles[i]);
+            if (k.len != recs[i].size() ||
+                compareKeys(k, keyRef(recs[i])) != 0) {
+                failures++;
+            }
+        }
+        size_t allocated = arena.getAllocated();
+        arena.clear();
+        if (arena.getAllocated() >= allocated) failures++;
+        if (round == 0) after_first = arena.getAllocated();
+        else if (arena.getAllocated() != after_first) failures++;
+    }
+    return failures;
+}
+
+// Key sets:
+// 0  long shared prefixes, past 8 bytes and past a radix pass per byte
+// 1  short keys over {0x00, 0x01, 0xFF}: many prefixes of other keys
+//    and many duplicates
+// 2  a few distinct keys repeated
+// 3  random bytes, random lengths
+const int NUM_KEY_SETS = 4;
+
+std::vector<std::string> makeKeys(int set, size_t n) {
+    Rng rng;
+    std::vector<std::string> keys;
+    const std::string shared(100, 'p');
+    for (size_t i = 0; i < n; i++) {
+        std::string k;
+        switch (set) {
+        case 0:
+            k = shared.substr(0, 40 + rng.below(3) * 30);
+            for (uint32_t j = rng.below(6); j > 0; j--) k += (char)rng.below(3);
+            break;
+        case 1: {
+            const char alphabet[] = {0x00, 0x01, (char)0xFF};
+            for (uint32_t j = rng.below(6); j > 0; j--) k += alphabet[rng.below(3)];
+            break;
+        }
+        case 2:
+            k = std::string(1 + rng.below(5), (char)('a' + rng.below(3)));
+            break;
+        default:
+            for (uint32_t j = rng.below(24); j > 0; j--) k += (char)rng.next();
+            break;
+        }
+        keys.push_back(k);
+    }
+    return keys;
+}
+
+Table* makeTable(const std::vector<std::string>& keys, RecordDef* ps) {
+    Table* t = new Table(ps);
+    for (const std::string& k : keys) {
+        memcpy(t->reserveRecord(k.size()), k.data(), k.size());
+        t->commitRecord(k.size());
+    }
+    return t;
+}
+
+Table* makeTable(const std::vector<std::string>& keys) {
+    return makeTable(keys, new RecordDef(1));
+}
+
+std::string keyAt(const Table* t, int i) {
+    return std::string((const char*)t->getData(i), t->getLen(i));
+}
+
+// std::string compares as memcmp, then the shorter first, as
+// compareKeys()
+bool sameKeys(const Table* t, const std::vector<std::string>& sorted) {
+    if (t->getNumRecords() != (int)sorted.size()) return false;
+    for (int i = 0; i < t->getNumRecords(); i++) {
+        if (keyAt(t, i) != sorted[i]) return false;
+    }
+    return true;
+}
+
+// every engine against std::sort, over each key set, empty and single
+// key inputs, and inputs large enough for parallel_sort to split
+int checkSorts() {
+    int failures = 0;
+    const SortMethod methods[] = {SORT_COMPARE, SORT_PREFIX, SORT_RADIX,
+                                  SORT_PARALLEL};
+    const size_t sizes[] = {0, 1, 2, 33, 300, 5000, 3 * PARALLEL_MIN_RECORDS};
+    for (int set = 0; set < NUM_KEY_SETS; set++) {
+        for (size_t n : sizes) {
+            std::vector<std::string> keys = makeKeys(set, n);
+            std::vector<std::string> sorted = keys;
+            std::sort(sorted.begin(), sorted.end());
+            for (SortMethod m : methods) {
+                Table* t = makeTable(keys);
+                t->sort(m, 4);
+                if (!sameKeys(t, sorted)) failures++;
+                delete t;
+            }
+        }
+    }
+    return failures;
+}
+
+// ExternalSorter against std::sort: in memory, and with the smallest
+// budget, which spills many runs that take several merge passes (a
+// fan-in of 2); plus a key too long for the batch, and empty input
+int checkExternalSort() {
+    int failures = 0;
+    const size_t sizes[] = {0, 1, 300, 20000};
+    for (int set = 0; set < NUM_KEY_SETS; set++) {
+        for (size_t n : sizes) {
+            std::vector<std::string> keys = makeKeys(set, n);
+            if (set == 0 && n > 1) {
+                keys.push_back(std::string(3 * ExternalSorter::MIN_RUN_BUF, 'p'));
+            }
+            std::vector<std::string> sorted = keys;
+            std::sort(sorted.begin(), sorted.end());
+            for (size_t budget : {(size_t)0, (size_t)64 << 20}) {
+                ExternalSorter sorter(budget);
+                for (const std::string& k : keys) {
+                    if (!sorter.add(k.data(), k.size())) failures++;
+                }
+                // more runs than the fan-in, so more than one merge pass
+                if (budget == 0 && n == 20000 && sorter.getNumRuns() <= 2) {
+                    failures++;
+                }
+                if (!sorter.finish()) failures++;
+                const uint8_t* key;
+                uint32_t len;
+                size_t i = 0;
+                while (sorter.next(key, len)) {
+                    if (i >= sorted.size() ||
+                        sorted[i] != std::string((const char*)key, len)) {
+                        failures++;
+                        break;
+                    }
+                    i++;
+                }
+                if (i != sorted.size() || sorter.failed()) failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+// the next count keys of it (all by default), against sorted from i
+// on; it must end with sorted
+bool sameFrom(KeyBlockReader::Iterator& it,
+              const std::vector<std::string>& sorted, size_t i,
+              size_t count = SIZE_MAX) {
+    size_t end = (sorted.size() - i > count) ? i + count : sorted.size();
+    for (; i < end; i++, it.next()) {
+        if (!it.valid() || compareKeys(it.key(), keyRef(sorted[i])) != 0) {
+            return false;
+        }
+    }
+    return end < sorted.size() || !it.valid();
+}
+
+// Key blocks written and read back, with small blocks and restart
+// intervals so that seeks cross blocks and restart points. Seeks to
+// every key, to keys between them, and before the first and past the
+// last key must land on std::lower_bound. Then open() must reject
+// truncated data and a corrupt footer or restart count.
+int checkKeyBlocks() {
+    int failures = 0;
+    const size_t sizes[] = {0, 1, 300, 5000};
+    for (int set = 0; set < NUM_KEY_SETS; set++) {
+        for (size_t n : sizes) {
+            std::vector<std::string> sorted = makeKeys(set, n);
+            std::sort(sorted.begin(), sorted.end());
+            KeyBlockBuilder builder(64, 4);
+            for (const std::string& k : sorted) builder.add(k.data(), k.size());
+            std::vector<uint8_t> data = builder.finish();
+
+            KeyBlockReader reader;
+            if (!reader.open(data.data(), data.size()) ||
+                reader.getNumKeys() != n) {
+                failures++;
+                continue;
+            }
+            KeyBlockReader::Iterator it(&reader);
+            it.seekToFirst();
+            if (!sameFrom(it, sorted, 0)) failures++;
+
+            std::vector<std::string> probes = makeKeys(set, 200);
+            probes.push_back(std::string());
+            probes.push_back(std::string(200, (char)0xFF));
+            for (size_t i = 0; i < sorted.size(); i += 7) {
+                probes.push_back(sorted[i]);
+                probes.push_back(sorted[i] + '\0');
+            }
+            if (n) probes.push_back(sorted.back());
+            for (const std::string& probe : probes) {
+                size_t i = std::lower_bound(sorted.begin(), sorted.end(), probe)
+                           - sorted.begin();
+                it.seek(keyRef(probe));
+                if (!sameFrom(it, sorted, i, 20)) failures++;
+            }
+
+            for (size_t len = 0; len < data.size(); len += 1 + len / 4) {
+                if (reader.open(data.data(), len)) failures++;
+            }
+            if (n == 0) continue;
+            size_t footer = data.size() - KEY_BLOCK_FOOTER_LEN;
+            uint64_t index_offset = key_block::getFixed64(&data[footer]);
+            // the restart count of the last block, the index offset,
+            // the block count and the magic
+            const size_t corrupt[] = {index_offset - 1, footer + 1, footer + 16,
+                                      footer + 23};
+            for (size_t at : corrupt) {
+                std::vector<uint8_t> bad = data;
+                bad[at] ^= 0x80;
+                if (reader.open(bad.data(), bad.size())) failures++;
+            }
+        }
+    }
+    return failures;
+}
+
+RecordDef* makeSchema(bool asc, Encoding enc) {
+    RecordDef* ps = new RecordDef(2);
+    ps->setFieldDef(0, TYPE_LONG, true);
+    ps->setFieldDef(1, TYPE_STRING, asc, enc);
+    return ps;
+}
+
+bool writeFile(const std::string& path, const std::vector<uint8_t>& data) {
+    FILE* fp = fopen(path.c_str(), "wb");
+    if (!fp) return false;
+    bool ok = data.empty() ||
+              fwrite(data.data(), 1, data.size(), fp) == data.size();
+    return (fclose(fp) == 0) && ok;
+}
+
+std::vector<uint8_t> readFile(const std::string& path) {
+    std::vector<uint8_t> data;
+    FILE* fp = fopen(path.c_str(), "rb");
+    if (!fp) return data;
+    uint8_t buf[4096];
+    size_t got;
+    while ((got = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data.insert(data.end(), buf, buf + got);
+    }
+    fclose(fp);
+    return data;
+}
+
+// A key index written from a sorted table and opened again: its schema
+// and keys, and lowerBound() against std::lower_bound, from the start
+// and from a later key. Then open() must reject the file truncated and
+// with a corrupt header, field or last offset, and sameSchema() must
+// be false for other schemas and with no index open.
+int checkKeyIndex() {
+    int failures = 0;
+    std::string path = "/tmp/sope_table_test_" + std::to_string(getpid()) + ".idx";
+    RecordDef* same = makeSchema(false, ENCODING_GROUP);
+    RecordDef* other_order = makeSchema(true, ENCODING_GROUP);
+    RecordDef* other_enc = makeSchema(false, ENCODING_DEFAULT);
+    RecordDef* fewer = new RecordDef(1);
+    fewer->setFieldDef(0, TYPE_LONG, true);
+    const size_t sizes[] = {0, 1, 300, 5000};
+    for (int set = 0; set < NUM_KEY_SETS; set++) {
+        for (size_t n : sizes) {
+            std::vector<std::string> sorted = makeKeys(set, n);
+            Table* t = makeTable(sorted, makeSchema(false, ENCODING_GROUP));
+            if (n > 1 && writeKeyIndex(*t, path)) failures++;    // unsorted
+            t->sort();
+            std::sort(sorted.begin(), sorted.end());
+            if (!writeKeyIndex(*t, path)) failures++;
+            delete t;
+
+            KeyIndex idx;
+            if (idx.sameSchema(same)) failures++;
+            if (!idx.open(path) || idx.getNumKeys() != n) {
+                failures++;
+                continue;
+            }
+            if (!idx.sameSchema(same) || idx.sameSchema(other_order) ||
+                idx.sameSchema(other_enc) || idx.sameSchema(fewer)) {
+                failures++;
+            }
+            for (size_t i = 0; i < n; i++) {
+                if (compareKeys(idx.getKey(i), keyRef(sorted[i])) != 0) {
+                    failures++;
+                    break;
+                }
+            }
+            std::vector<std::string> probes = makeKeys(set, 200);
+            probes.push_back(std::string());
+            probes.push_back(std::string(200, (char)0xFF));
+            for (size_t i = 0; i < n; i += 7) probes.push_back(sorted[i]);
+            for (const std::string& probe : probes) {
+                size_t i = std::lower_bound(sorted.begin(), sorted.end(), probe)
+                           - sorted.begin();
+                if (idx.lowerBound(keyRef(probe)) != i) failures++;
+                size_t from = n / 2;
+                size_t j = std::lower_bound(sorted.begin() + from, sorted.end(),
+                                            probe) - sorted.begin();
+                if (idx.lowerBound(keyRef(probe), from) != j) failures++;
+            }
+            idx.close();
+            if (idx.sameSchema(same)) failures++;
+
+            std::vector<uint8_t> data = readFile(path);
+            for (size_t len = 0; len < data.size(); len += 1 + len / 4) {
+                std::vector<uint8_t> bad(data.begin(), data.begin() + len);
+                if (writeFile(path, bad) && idx.open(path)) failures++;
+            }
+            // magic, version, field count, key count, offset[] and key
+            // positions, the type and encoding of a field
+            const size_t corrupt[] = {0, 11, 15, 23, 31, 39, 40, 46};
+            for (size_t at : corrupt) {
+                std::vector<uint8_t> bad = data;
+                bad[at] ^= 0x40;
+                if (writeFile(path, bad) && idx.open(path)) failures++;
+            }
+            // the last offset past the end of the keys
+            std::vector<uint8_t> bad = data;
+            uint64_t keys_at = key_index::getFixed64(&data[32]);
+            key_index::putFixed64(&bad[keys_at - sizeof(uint64_t)],
+                                  data.size() - keys_at + 1);
+            if (writeFile(path, bad) && idx.open(path)) failures++;
+        }
+    }
+    unlink(path.c_str());
+    delete same;
+    delete other_order;
+    delete other_enc;
+    delete fewer;
+    return failures;
+}
+
+// v as 8 big-endian bytes, then a tail of up to 3 bytes
+std::string prefixKey(uint64_t v, Rng& rng) {
+    std::string k;
+    for (int shift = 56; shift >= 0; shift -= 8) k += (char)(v >> shift);
+    for (uint32_t j = rng.below(4); j > 0; j--) k += (char)rng.below(3);
+    return k;
+}
+
+// PrefixIndex lookups against std::lower_bound over the sorted keys,
+// with uniform prefixes, skewed ones (most of them small, so the
+// segments fit badly and the search widens), and the key sets above
+// (short keys, long runs of equal prefixes). Probes are the keys,
+// keys next to them, random keys and keys past both ends.
+int checkPrefixIndex() {
+    int failures = 0;
+    const size_t sizes[] = {0, 1, 300, 5000};
+    const uint32_t errors[] = {1, 4, 32};
+    for (int set = 0; set < NUM_KEY_SETS + 2; set++) {
+        for (size_t n : sizes) {
+            std::vector<std::string> sorted;
+            Rng rng;
+            if (set < NUM_KEY_SETS) {
+                sorted = makeKeys(set, n);
+            } else {
+                for (size_t i = 0; i < n; i++) {
+                    uint64_t v = rng.next();
+                    if (set == NUM_KEY_SETS + 1) v >>= rng.below(64);
+                    sorted.push_back(prefixKey(v, rng));
+                }
+            }
+            std::sort(sorted.begin(), sorted.end());
+            Table* t = makeTable(sorted);
+
+            std::vector<std::string> probes;
+            probes.push_back(std::string());
+            probes.push_back(std::string(200, (char)0xFF));
+            for (size_t i = 0; i < 500; i++) {
+                probes.push_back(prefixKey(rng.next() >> rng.below(64), rng));
+            }
+            for (size_t i = 0; i < n; i += 7) {
+                const std::string& k = sorted[i];
+                probes.push_back(k);
+                probes.push_back(k + '\0');
+                probes.push_back(k.substr(0, k.size() / 2));
+                uint64_t p = keyPrefix(keyRef(k));
+                probes.push_back(prefixKey(p + 1, rng));
+                probes.push_back(prefixKey(p - 1, rng));
+            }
+            for (uint32_t max_error : errors) {
+                PrefixIndex idx(*t, max_error);
+                for (const std::string& probe : probes) {
+                    size_t i = std::lower_bound(sorted.begin(), sorted.end(),
+                                                probe) - sorted.begin();
+                    if (idx.lowerBound(keyRef(probe)) != (int)i) failures++;
+                }
+            }
+            delete t;
+        }
+    }
+    return failures;
+}
+
+// Rows of a schema with every kind of field: a fixed ascending INT, a
+// descending string, an ascending binary in groups, a descending
+// varint LONG. Values come from small domains (with NULLs), so rows
+// share prefixes and repeat; strings and binaries point into the
+// domains below.
+const int ROW_FIELDS = 4;
+typedef std::vector<FieldValue> Row;
+
+const std::vector<std::string> STRINGS = {
+    "", "a", "ab", "abc", "b", "ba", "\x01", "\xFF\xFE", "zzzzzzzzzz"};
+const std::vector<std::string> BINARIES = {
+    "", std::string(1, '\0'), std::string(2, '\0'), std::string("a\0b", 3),
+    "a", std::string("\xFF\0", 2), "12345678", "123456789"};
+
+RecordDef* makeRowSchema() {
+    RecordDef* ps = new RecordDef(ROW_FIELDS);
+    ps->setFieldDef(0, TYPE_INT, true);
+    ps->setFieldDef(1, TYPE_STRING, false);
+    ps->setFieldDef(2, TYPE_BINARY, true, ENCODING_GROUP);
+    ps->setFieldDef(3, TYPE_LONG, false, ENCODING_VARINT);
+    return ps;
+}
+
+FieldValue intValue(int i) {
+    FieldValue v;
+    v.isNull = false;
+    v.i = i;
+    return v;
+}
+
+FieldValue longValue(long l) {
+    FieldValue v;
+    v.isNull = false;
+    v.l = l;
+    return v;
+}
+
+FieldValue bytesValue(const std::string& s) {
+    FieldValue v;
+    v.isNull = false;
+    v.ptr = s.data();
+    v.len = s.size();
+    return v;
+}
+
+// a value of field f, or NULL about once in 8
+FieldValue randomValue(int f, Rng& rng) {
+    if (rng.below(8) == 0) return FieldValue();
+    switch (f) {
+    case 0:  return intValue((int)rng.below(10) - 3);
+    case 1:  return bytesValue(STRINGS[rng.below(STRINGS.size())]);
+    case 2:  return bytesValue(BINARIES[rng.below(BINARIES.size())]);
+    default: return longValue((long)rng.below(2001) - 1000);
+    }
+}
+
+std::vector<Row> makeRows(size_t n, Rng& rng) {
+    std::vector<Row> rows(n, Row(ROW_FIELDS));
+    for (Row& row : rows) {
+        for (int f = 0; f < ROW_FIELDS; f++) row[f] = randomValue(f, rng);
+    }
+    return rows;
+}
+
+Table* makeRowTable(const std::vector<Row>& rows) {
+    Table* t = new Table(makeRowSchema());
+    RecordPlan plan(t->getSchema());
+    for (const Row& row : rows) {
+        uint32_t len = calcEncodedLen(t->getSchema(), row.data());
+        t->commitRecord(plan.encode(row.data(), t->reserveRecord(len)));
+    }
+    t->sort();
+    return t;
+}
+
+// equalities on the first n columns of row
+KeyCondition equalTo(const RecordDef* ps, const Row& row, int n) {
+    KeyCondition cond(ps);
+    for (int f = 0; f < n; f++) cond.equal(row[f]);
+    return cond;
+}
+
+// A PrefixBloom on the first 1 to 4 columns. Conditions that are
+// equalities on at least the filtered columns, and the records
+// themselves, must pass for every row of the table; about 1% of the
+// equalities with an absent prefix (an INT out of its domain) may.
+// Ranges on a filtered column and conditions on fewer columns cannot
+// be filtered and must pass. (A range with equal inclusive bounds is
+// an equality, and is filtered.)
+int checkPrefixBloom() {
+    int failures = 0;
+    Rng rng;
+    std::vector<Row> rows = makeRows(3000, rng);
+    Table* t = makeRowTable(rows);
+    const RecordDef* ps = t->getSchema();
+    for (int n_columns = 1; n_columns <= ROW_FIELDS; n_columns++) {
+        PrefixBloom bloom(ps, n_columns, t->getNumRecords());
+        bloom.build(*t);
+        for (int i = 0; i < t->getNumRecords(); i++) {
+            if (!bloom.mayContain(t->getArena().getKey(t->getHandle(i)))) {
+                failures++;
+            }
+        }
+        for (const Row& row : rows) {
+            for (int n = 0; n <= ROW_FIELDS; n++) {
+                if (!bloom.mayContain(equalTo(ps, row, n))) failures++;
+            }
+        }
+        int passed = 0;
+        const int ABSENT = 2000;
+        for (int i = 0; i < ABSENT; i++) {
+            Row row = rows[rng.below(rows.size())];
+            row[0] = intValue(100 + i);
+            if (bloom.mayContain(equalTo(ps, row, n_columns))) passed++;
+            // a range on the last filtered column, open above
+            KeyCondition range = equalTo(ps, row, n_columns - 1);
+            FieldValue lo = row[n_columns - 1];
+            range.range(lo.isNull ? nullptr : &lo, true, nullptr, false);
+            if (!bloom.mayContain(range)) failures++;
+            if (!bloom.mayContain(equalTo(ps, row, n_columns - 1))) failures++;
+        }
+        if (passed > ABSENT / 20) failures++;
+    }
+    delete t;
+    return failures;
+}
+
+// BatchLookup::lowerBounds() against one lowerBound() per probe, and
+// std::lower_bound, for probe batches in random order, sorted, with
+// repeats, past the last key, and empty; ranges() against the two
+// bounds of each range.
+int checkBatchLookup() {
+    int failures = 0;
+    const size_t sizes[] = {0, 1, 300, 5000};
+    for (int set = 0; set < NUM_KEY_SETS; set++) {
+        for (size_t n : sizes) {
+            std::vector<std::string> sorted = makeKeys(set, n);
+            std::sort(sorted.begin(), sorted.end());
+            Table* t = makeTable(sorted);
+            BatchLookup batch(*t);
+            Rng rng;
+
+            std::vector<std::string> probes = makeKeys(set, 400);
+            for (size_t i = 0; i < n; i += 11) {
+                probes.push_back(sorted[i]);
+                probes.push_back(sorted[i]);
+            }
+            for (int i = 0; i < 5; i++) {
+                probes.push_back(std::string(200 + i, (char)0xFF));
+            }
+            for (size_t i = probes.size(); i > 1; i--) {
+                std::swap(probes[i - 1], probes[rng.below(i)]);
+            }
+            std::vector<std::string> in_order = probes;
+            std::sort(in_order.begin(), in_order.end());
+            for (const std::vector<std::string>* batch_keys : {&probes, &in_order}) {
+                std::vector<KeyRef> keys;
+                for (const std::string& k : *batch_keys) keys.push_back(keyRef(k));
+                std::vector<int> out(keys.size());
+                batch.lowerBounds(keys.data(), keys.size(), out.data());
+                for (size_t i = 0; i < keys.size(); i++) {
+                    size_t at = std::lower_bound(sorted.begin(), sorted.end(),
+                                                 (*batch_keys)[i]) - sorted.begin();
+                    if (out[i] != lowerBound(*t, keys[i]) || out[i] != (int)at) {
+                        failures++;
+                    }
+                }
+                // ranges between probe i and probe i + 1, in either order
+                size_t n_ranges = keys.size() - 1;
+                std::vector<RowRange> ranges(n_ranges);
+                batch.ranges(keys.data(), keys.data() + 1, n_ranges, ranges.data());
+                for (size_t i = 0; i < n_ranges; i++) {
+                    int begin = lowerBound(*t, keys[i]);
+                    int end = std::max(begin, lowerBound(*t, keys[i + 1]));
+                    if (ranges[i].begin != begin || ranges[i].end != end) failures++;
+                }
+            }
+            batch.lowerBounds(nullptr, 0, nullptr);
+            delete t;
+        }
+    }
+    return failures;
+}
+
+// <0, 0, >0 as the values (not NULL) of field f of the row schema
+int compareValues(int f, const FieldValue& a, const FieldValue& b) {
+    switch (f) {
+    case 0: return (a.i > b.i) - (a.i < b.i);
+    case 3: return (a.l > b.l) - (a.l < b.l);
+    default: {
+        int c = a.len && b.len ? memcmp(a.ptr, b.ptr, std::min(a.len, b.len)) : 0;
+        return c ? c : (a.len > b.len) - (a.len < b.len);
+    }
+    }
+}
+
+// a condition on rows, as given to KeyCondition: equalities on the
+// first columns, then maybe a range
+struct RowCondition {
+    std::vector<FieldValue> equal;
+    bool                    range;
+    FieldValue              lo, hi;     // NULL: open
+    bool                    loIncl, hiIncl;
+
+    bool matches(const Row& row) const {
+        for (size_t f = 0; f < equal.size(); f++) {
+            if (row[f].isNull != equal[f].isNull) return false;
+            if (!row[f].isNull && compareValues(f, row[f], equal[f]) != 0) {
+                return false;
+            }
+        }
+        if (!range) return true;
+        const FieldValue& v = row[equal.size()];
+        if (v.isNull) return false;
+        if (!lo.isNull) {
+            int c = compareValues(equal.size(), v, lo);
+            if (c < 0 || (c == 0 && !loIncl)) return false;
+        }
+        if (!hi.isNull) {
+            int c = compareValues(equal.size(), v, hi);
+            if (c > 0 || (c == 0 && !hiIncl)) return false;
+        }
+        return true;
+    }
+
+    KeyCondition build(const RecordDef* ps) const {
+        KeyCondition cond(ps);
+        for (const FieldValue& v : equal) cond.equal(v);
+        if (range) {
+            cond.range(lo.isNull ? nullptr : &lo, loIncl,
+                       hi.isNull ? nullptr : &hi, hiIncl);
+        }
+        return cond;
+    }
+};
+
+// equalities from a row of the table (or random values, NULLs
+// included), then a range with random bounds, open, inclusive or not
+RowCondition randomCondition(const std::vector<Row>& rows, Rng& rng) {
+    RowCondition c;
+    const Row& row = rows[rng.below(rows.size())];
+    int n_equal = rng.below(ROW_FIELDS + 1);
+    for (int f = 0; f < n_equal; f++) {
+        c.equal.push_back(rng.below(4) ? row[f] : randomValue(f, rng));
+    }
+    c.range = n_equal < ROW_FIELDS && rng.below(3) != 0;
+    if (c.range) {
+        int f = n_equal;
+        do c.lo = randomValue(f, rng); while (c.lo.isNull);
+        do c.hi = randomValue(f, rng); while (c.hi.isNull);
+        if (compareValues(f, c.lo, c.hi) > 0) std::swap(c.lo, c.hi);
+        if (rng.below(4) == 0) c.lo = FieldValue();
+        if (rng.below(4) == 0) c.hi = FieldValue();
+        c.loIncl = rng.below(2);
+        c.hiIncl = rng.below(2);
+    }
+    return c;
+}
+
+// RangeScan over KeyCondition keys against a filtered full scan, and
+// BatchLookup::ranges() on the same conditions, over rows with
+// ascending and descending columns, NULLs, groups and varints
+int checkRangeScan() {
+    int failures = 0;
+    Rng rng;
+    std::vector<Row> rows = makeRows(3000, rng);
+    Table* t = makeRowTable(rows);
+    const RecordDef* ps = t->getSchema();
+    RecordPlan plan(ps);
+    // the rows in table order, decoded
+    std::vector<Row> sorted(t->getNumRecords(), Row(ROW_FIELDS));
+    std::vector<std::vector<uint8_t> > work(t->getNumRecords());
+    for (int i = 0; i < t->getNumRecords(); i++) {
+        work[i].resize(t->getLen(i));
+        plan.decode(t->getData(i), sorted[i].data(), work[i].data());
+    }
+
+    std::vector<RowCondition> conds;
+    for (int i = 0; i < 2000; i++) conds.push_back(randomCondition(rows, rng));
+    std::vector<KeyCondition> keys;
+    for (const RowCondition& c : conds) keys.push_back(c.build(ps));
+    std::vector<RowRange> ranges(conds.size());
+    BatchLookup batch(*t);
+    batch.ranges(keys.data(), keys.size(), ranges.data());
+
+    int matched = 0;
+    for (size_t c = 0; c < conds.size(); c++) {
+        std::vector<int> expected;
+        for (int i = 0; i < t->getNumRecords(); i++) {
+            if (conds[c].matches(sorted[i])) expected.push_back(i);
+        }
+        std::vector<int> got;
+        RangeScan scan(*t, keys[c]);
+        KeyRef rec;
+        while (scan.next(rec)) got.push_back(scan.getPos() - 1);
+        if (got != expected) failures++;
+        int begin = got.empty() ? ranges[c].begin : got.front();
+        if (ranges[c].begin != begin ||
+            ranges[c].end != begin + (int)got.size()) {
+            failures++;
+        }
+        matched += !got.empty();
+    }
+    // most conditions come from rows of the table, so most match
+    if (matched < (int)conds.size() / 4) failures++;
+    delete t;
+    return failures;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    int failures = 0;
+    failures += report("RecordArena records and clear()", checkArena());
+    failures += report("Sort engines against std::sort", checkSorts());
+    failures += report("ExternalSorter against std::sort", checkExternalSort());
+    failures += report("Key blocks against std::lower_bound", checkKeyBlocks());
+    failures += report("Key index against std::lower_bound", checkKeyIndex());
+    failures += report("PrefixIndex against std::lower_bound", checkPrefixIndex());
+    failures += report("PrefixBloom on present and absent prefixes", checkPrefixBloom());
+    failures += report("BatchLookup against lowerBound()", checkBatchLookup());
+    failures += report("RangeScan against a filtered full scan", checkRangeScan());
+
+    return failures ? 1 : 0;
+}
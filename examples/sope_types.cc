@@ -16,6 +16,8 @@ limitations under the License.
 ******************************************************************/
 #include "sope_types.h"
 
+#include <ctime>
+
 namespace sope {
 
 std::string toString(Date d) {
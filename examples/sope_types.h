@@ -43,6 +43,13 @@ enum Type : int {
     TYPE_OBJECT     = 9, // internally binary.
 };
 
+// Format of a field, for types that have more than one.
+enum Encoding : uint8_t {
+    ENCODING_DEFAULT = 0,   // the formats of sope_encode.h
+    ENCODING_GROUP   = 1,   // strings, binaries: fixed 8-byte groups
+    ENCODING_VARINT  = 2,   // integers, Date, Timestamp: varint
+};
+
 const uint32_t LEN_NULL = 1;
 const uint32_t LEN_INT = 4;
 const uint32_t LEN_LONG = 8;
@@ -0,0 +1,559 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#include "sope_range_scan.h"
+#include "sope_record_plan.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <sys/resource.h>
+#include <tuple>
+#include <unistd.h>
+#include <vector>
+
+using namespace sope;
+using namespace sope_test;
+
+/************************************************
+End-to-end workload: synthesizes a table from a
+schema, then times
+
+  encode  rows into a Table, through RecordPlan
+  sort    Table::sort() with the chosen method
+  scan    equality range scans on the 1st column
+  decode  all records, in sorted order
+
+and, as a baseline, std::sort of the native rows
+with a typed comparator (a std::tuple of NULL
+flag and value per field). The report is JSON on
+stdout: per phase seconds, rows/s, MB/s of
+encoded bytes and RSS, and the peak RSS.
+
+usage: sope_workload [--option=value ...]
+  --rows=N          rows (default 1000000)
+  --schema=SPEC     fields, e.g. long,string:desc,int
+                    types: int long double bool string
+                    date timestamp binary object;
+                    :group for string/binary/object
+                    in fixed groups, :varint for
+                    int/long/date/timestamp
+                    (default long,string,int:desc,binary)
+  --nulls=F         fraction of NULL fields (0.05)
+  --str-len=LO-HI   string/binary lengths, uniform (4-32)
+  --zeros=F         fraction of 0x00 bytes in binaries (0.01)
+  --distinct=N      values per column (default rows)
+  --skew=S          Zipf skew of the 1st column, 0 for
+                    uniform, up to 0.99 (0)
+  --sort=M          compare, prefix, radix, parallel (radix)
+  --threads=N       for --sort=parallel (0: one per core)
+  --scans=N         equality scans on the 1st column (10000)
+  --baseline=0|1    the std::tuple sort (1); it keeps the
+                    native rows in memory, 0 for large runs
+  --seed=N          (1)
+
+The values of a column are a function of a rank
+drawn in [0, distinct), so the scans probe the
+same distribution as the table. The baseline
+order is checked against the encoded keys.
+**************************************************/
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct Config {
+    size_t      rows = 1000000;
+    std::string schema = "long,string,int:desc,binary";
+    double      nulls = 0.05;
+    uint32_t    strMin = 4;
+    uint32_t    strMax = 32;
+    double      zeros = 0.01;
+    uint64_t    distinct = 0;
+    double      skew = 0;
+    std::string sort = "radix";
+    int         threads = 0;
+    size_t      scans = 10000;
+    bool        baseline = true;
+    uint64_t    seed = 1;
+};
+
+bool parseArg(const char* arg, Config& c) {
+    const char* eq = strchr(arg, '=');
+    if (strncmp(arg, "--", 2) != 0 || !eq) return false;
+    std::string name(arg + 2, eq - arg - 2);
+    const char* v = eq + 1;
+    if (name == "rows")          c.rows = strtoull(v, nullptr, 10);
+    else if (name == "schema")   c.schema = v;
+    else if (name == "nulls")    c.nulls = atof(v);
+    else if (name == "str-len")  return sscanf(v, "%u-%u", &c.strMin, &c.strMax) == 2
+                                        && c.strMin <= c.strMax;
+    else if (name == "zeros")    c.zeros = atof(v);
+    else if (name == "distinct") c.distinct = strtoull(v, nullptr, 10);
+    else if (name == "skew")     c.skew = atof(v);
+    else if (name == "sort")     c.sort = v;
+    else if (name == "threads")  c.threads = atoi(v);
+    else if (name == "scans")    c.scans = strtoull(v, nullptr, 10);
+    else if (name == "baseline") c.baseline = atoi(v) != 0;
+    else if (name == "seed")     c.seed = strtoull(v, nullptr, 10);
+    else return false;
+    return true;
+}
+
+struct FieldSpec {
+    Type     type;
+    bool     asc;
+    Encoding enc;
+};
+
+// "long,string:desc:group" -> schema, nullptr if a type or an option
+// is unknown
+RecordDef* parseSchema(const std::string& spec) {
+    std::vector<FieldSpec> fields;
+    size_t pos = 0;
+    while (pos <= spec.size()) {
+        size_t end = spec.find(',', pos);
+        if (end == std::string::npos) end = spec.size();
+        std::string f = spec.substr(pos, end - pos);
+        bool asc = true;
+        Encoding enc = ENCODING_DEFAULT;
+        size_t colon = f.find(':');
+        if (colon != std::string::npos) {
+            std::string opts = f.substr(colon + 1) + ":";
+            f.resize(colon);
+            for (size_t o = 0; o < opts.size(); ) {
+                size_t next = opts.find(':', o);
+                std::string opt = opts.substr(o, next - o);
+                if (opt == "asc" || opt == "desc") asc = (opt == "asc");
+                else if (opt == "group") enc = ENCODING_GROUP;
+                else if (opt == "varint") enc = ENCODING_VARINT;
+                else return nullptr;
+                o = next + 1;
+            }
+        }
+        for (char& ch : f) ch = toupper(ch);
+        Type t = convert2Type(f);
+        if (t == TYPE_NULL) return nullptr;
+        if (!RecordDef::isValidEncoding(t, enc)) return nullptr;
+        fields.push_back({t, asc, enc});
+        pos = end + 1;
+    }
+    RecordDef* ps = new RecordDef(fields.size());
+    for (size_t i = 0; i < fields.size(); i++) {
+        ps->setFieldDef(i, fields[i].type, fields[i].asc, fields[i].enc);
+    }
+    return ps;
+}
+
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb93e53ca63e9ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Zipf ranks in [0, n) (Gray et al., as in YCSB), uniform for skew 0
+class RankGen {
+public:
+    RankGen(uint64_t n, double skew) : n(n), theta(std::min(skew, 0.99)) {
+        if (theta <= 0) return;
+        zetan = 0;
+        for (uint64_t i = 1; i <= n; i++) zetan += 1 / pow((double)i, theta);
+        double zeta2 = 1 + 1 / pow(2.0, theta);
+        alpha = 1 / (1 - theta);
+        eta = (1 - pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+    }
+
+    uint64_t next(std::mt19937_64& rng) const {
+        if (theta <= 0) return rng() % n;
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        double uz = u * zetan;
+        if (uz < 1) return 0;
+        if (uz < 1 + pow(0.5, theta)) return 1;
+        uint64_t r = (uint64_t)(n * pow(eta * u - eta + 1, alpha));
+        return r < n ? r : n - 1;
+    }
+
+private:
+    uint64_t n;
+    double   theta;
+    double   zetan = 0;
+    double   alpha = 0;
+    double   eta = 0;
+};
+
+/*
+ * Rows in native form, in chunks: FieldValues, with the bytes of
+ * strings and binaries in a pool per chunk.
+ */
+struct Chunk {
+    std::vector<FieldValue> values;
+    std::vector<uint8_t>    bytes;
+};
+
+class Generator {
+public:
+    Generator(const Config& c, const RecordDef* ps)
+        : cfg(c)
+        , pSchema(ps)
+        , distinct(c.distinct ? c.distinct : std::max<size_t>(c.rows, 1))
+        , lead(distinct, c.skew)
+        , rng(c.seed) {}
+
+    // value of column i for rank r; bytes of strings and binaries are
+    // appended to pool, and v.ptr holds their offset
+    void valueOf(int i, uint64_t r, FieldValue& v, std::vector<uint8_t>& pool) const {
+        uint64_t h = mix64(r * 0x9E3779B97F4A7C15ULL + i + cfg.seed);
+        v.isNull = false;
+        switch (pSchema->getType(i)) {
+        case TYPE_INT:       v.i = (int)h; break;
+        case TYPE_LONG:      v.l = (long)h; break;
+        case TYPE_DOUBLE:    v.d = (double)(long)(h >> 11) / 1024; break;
+        case TYPE_BOOL:      v.b = h & 1; break;
+        case TYPE_DATE:      v.l = (long)(h % 4102444800000ULL); break;  // < 2100
+        case TYPE_TIMESTAMP: v.ts = h; break;
+        case TYPE_STRING:
+        case TYPE_BINARY:
+        case TYPE_OBJECT: {
+            bool str = (pSchema->getType(i) == TYPE_STRING);
+            v.len = cfg.strMin + h % (cfg.strMax - cfg.strMin + 1);
+            v.ptr = _RC(const void*, (uintptr_t)pool.size());
+            uint64_t s = h;
+            for (uint32_t k = 0; k < v.len; k++) {
+                s = mix64(s + k);
+                uint8_t b;
+                if (str) {
+                    b = 0x20 + s % 95;                  // printable
+                } else {
+                    b = ((s >> 8) % 1000000 < cfg.zeros * 1000000) ? 0 : 1 + s % 255;
+                }
+                pool.push_back(b);
+            }
+            break; }
+        case TYPE_NULL: v.isNull = true; break;
+        }
+    }
+
+    // n rows: the 1st column from the (skewed) key ranks, the others
+    // uniform
+    void fill(size_t n, Chunk& chunk) {
+        int n_fields = pSchema->getNumFields();
+        chunk.values.assign(n * n_fields, FieldValue());
+        chunk.bytes.clear();
+        std::uniform_real_distribution<double> u(0, 1);
+        for (size_t r = 0; r < n; r++) {
+            for (int i = 0; i < n_fields; i++) {
+                FieldValue& v = chunk.values[r * n_fields + i];
+                uint64_t rank = (i == 0) ? lead.next(rng) : rng() % distinct;
+                if (u(rng) < cfg.nulls) continue;
+                valueOf(i, rank, v, chunk.bytes);
+            }
+        }
+        fixPointers(chunk);
+    }
+
+    // condition values for the scans: ranks of the 1st column
+    uint64_t nextLeadRank() { return lead.next(rng); }
+
+    static void fixPointers(Chunk& chunk) {
+        for (FieldValue& v : chunk.values) {
+            if (!v.isNull && v.len > 0) {
+                v.ptr = chunk.bytes.data() + (uintptr_t)v.ptr;
+            }
+        }
+    }
+
+private:
+    const Config&    cfg;
+    const RecordDef* pSchema;
+    uint64_t         distinct;
+    RankGen          lead;
+    std::mt19937_64  rng;
+};
+
+// -1, 0, 1 for a and b of one column, NULL first, in ascending order
+template <typename T>
+int compareTuples(const T& a, const T& b) {
+    return (a < b) ? -1 : (b < a) ? 1 : 0;
+}
+
+int compareField(Type t, const FieldValue& a, const FieldValue& b) {
+    // NULL fields keep the zero value of FieldValue()
+    bool na = !a.isNull;
+    bool nb = !b.isNull;
+    switch (t) {
+    case TYPE_INT:       return compareTuples(std::make_tuple(na, a.i), std::make_tuple(nb, b.i));
+    case TYPE_LONG:
+    case TYPE_DATE:      return compareTuples(std::make_tuple(na, a.l), std::make_tuple(nb, b.l));
+    case TYPE_DOUBLE:    return compareTuples(std::make_tuple(na, a.d), std::make_tuple(nb, b.d));
+    case TYPE_BOOL:      return compareTuples(std::make_tuple(na, a.b), std::make_tuple(nb, b.b));
+    case TYPE_TIMESTAMP: return compareTuples(std::make_tuple(na, a.ts), std::make_tuple(nb, b.ts));
+    case TYPE_STRING:
+    case TYPE_BINARY:
+    case TYPE_OBJECT:
+        // char_traits<char> compares as unsigned bytes, as memcmp
+        return compareTuples(
+            std::make_tuple(na, std::string_view(_SCCC(a.ptr), a.len)),
+            std::make_tuple(nb, std::string_view(_SCCC(b.ptr), b.len)));
+    case TYPE_NULL:      return 0;
+    }
+    return 0;
+}
+
+struct NativeLess {
+    const RecordDef* ps;
+    bool operator()(const FieldValue* a, const FieldValue* b) const {
+        for (int i = 0; i < ps->getNumFields(); i++) {
+            int c = compareField(ps->getType(i), a[i], b[i]);
+            if (c != 0) return ps->isAsc(i) ? c < 0 : c > 0;
+        }
+        return false;
+    }
+};
+
+size_t rssBytes() {
+    long size = 0;
+    long pages = 0;
+    FILE* fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        if (fscanf(fp, "%ld %ld", &size, &pages) != 2) pages = 0;
+        fclose(fp);
+    }
+    return (size_t)pages * sysconf(_SC_PAGESIZE);
+}
+
+size_t peakRssBytes() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (size_t)ru.ru_maxrss * 1024;     // KB on Linux
+}
+
+struct Phase {
+    std::string name;
+    double      seconds;
+    double      items;      // rows, or scans
+    double      bytes;      // encoded bytes processed
+    size_t      rss;
+    std::string extra;      // more JSON members, if any
+};
+
+double secondsSince(Clock::time_point t0) {
+    return std::chrono::duration<double>(Clock::now() - t0).count();
+}
+
+SortMethod sortMethodOf(const std::string& s, bool& ok) {
+    ok = true;
+    if (s == "compare") return SORT_COMPARE;
+    if (s == "prefix")  return SORT_PREFIX;
+    if (s == "radix")   return SORT_RADIX;
+    if (s == "parallel") return SORT_PARALLEL;
+    ok = false;
+    return SORT_COMPARE;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    Config cfg;
+    for (int k = 1; k < argc; k++) {
+        if (!parseArg(argv[k], cfg)) {
+            fprintf(stderr, "bad argument: %s (see the comment at the top "
+                            "of sope_workload.cc)\n", argv[k]);
+            return 1;
+        }
+    }
+    bool ok;
+    SortMethod method = sortMethodOf(cfg.sort, ok);
+    RecordDef* ps = parseSchema(cfg.schema);
+    if (!ok || !ps || cfg.rows == 0 || cfg.rows > (size_t)INT32_MAX) {
+        fprintf(stderr, "bad --sort, --schema or --rows\n");
+        delete ps;
+        return 1;
+    }
+    const int n_fields = ps->getNumFields();
+    const size_t CHUNK_ROWS = 1 << 16;
+
+    Table table(ps);
+    RecordPlan plan(ps);
+    Generator gen(cfg, ps);
+    std::vector<Phase> phases;
+
+    // generate and encode, chunk by chunk; the native rows are kept
+    // only for the baseline
+    std::vector<Chunk> kept;
+    Chunk chunk;
+    double gen_secs = 0;
+    double enc_secs = 0;
+    uint64_t enc_bytes = 0;
+    uint32_t max_len = 0;
+    for (size_t done = 0; done < cfg.rows; done += CHUNK_ROWS) {
+        size_t n = std::min(CHUNK_ROWS, cfg.rows - done);
+        Clock::time_point t0 = Clock::now();
+        gen.fill(n, chunk);
+        gen_secs += secondsSince(t0);
+
+        t0 = Clock::now();
+        for (size_t r = 0; r < n; r++) {
+            const FieldValue* row = &chunk.values[r * n_fields];
+            uint8_t* p = table.reserveRecord(calcEncodedLen(ps, row));
+            if (!p) {
+                fprintf(stderr, "out of memory at row %zu\n", done + r);
+                return 1;
+            }
+            uint32_t len = plan.encode(row, p);
+            table.commitRecord(len);
+            enc_bytes += len;
+            max_len = std::max(max_len, len);
+        }
+        enc_secs += secondsSince(t0);
+        if (cfg.baseline) kept.push_back(std::move(chunk));
+    }
+    phases.push_back({"generate", gen_secs, (double)cfg.rows, 0, rssBytes(), ""});
+    phases.push_back({"encode", enc_secs, (double)cfg.rows, (double)enc_bytes,
+                      rssBytes(), ""});
+
+    // the record of each row, to check the baseline order
+    std::vector<RecordHandle> handles;
+    if (cfg.baseline) {
+        handles.resize(cfg.rows);
+        for (size_t r = 0; r < cfg.rows; r++) handles[r] = table.getHandle(r);
+    }
+
+    Clock::time_point t0 = Clock::now();
+    table.sort(method, cfg.threads);
+    phases.push_back({"sort", secondsSince(t0), (double)cfg.rows,
+                      (double)enc_bytes, rssBytes(), ""});
+    for (int i = 1; i < table.getNumRecords(); i++) {
+        if (compareKeys(table.getArena().getKey(table.getHandle(i - 1)),
+                        table.getArena().getKey(table.getHandle(i))) > 0) {
+            fprintf(stderr, "table is not sorted at %d\n", i);
+            return 1;
+        }
+    }
+
+    // equality scans on the 1st column, values from its distribution
+    std::vector<KeyCondition> conds;
+    std::vector<uint8_t> pool;
+    conds.reserve(cfg.scans);
+    for (size_t k = 0; k < cfg.scans; k++) {
+        FieldValue v;
+        pool.clear();
+        gen.valueOf(0, gen.nextLeadRank(), v, pool);
+        if (!v.isNull && v.len > 0) v.ptr = pool.data() + (uintptr_t)v.ptr;
+        conds.emplace_back(ps);
+        conds.back().equal(v);
+    }
+    uint64_t scanned = 0;
+    uint64_t scanned_bytes = 0;
+    t0 = Clock::now();
+    for (const KeyCondition& cond : conds) {
+        RangeScan scan(table, cond);
+        KeyRef rec;
+        while (scan.next(rec)) {
+            scanned++;
+            scanned_bytes += rec.len;
+        }
+    }
+    phases.push_back({"scan", secondsSince(t0), (double)cfg.scans,
+                      (double)scanned_bytes, rssBytes(),
+                      "\"rows_returned\": " + std::to_string(scanned)});
+
+    // decode in sorted order
+    std::vector<FieldValue> out(n_fields);
+    std::vector<uint8_t> work(max_len + 1);
+    uint64_t sum = 0;
+    t0 = Clock::now();
+    for (int i = 0; i < table.getNumRecords(); i++) {
+        plan.decode(table.getData(i), out.data(), work.data());
+        for (int f = 0; f < n_fields; f++) {
+            sum += out[f].isNull ? 1 : out[f].len + (uint64_t)out[f].l;
+        }
+    }
+    phases.push_back({"decode", secondsSince(t0), (double)cfg.rows,
+                      (double)enc_bytes, rssBytes(), ""});
+
+    // baseline: the native rows with a std::tuple comparator
+    if (cfg.baseline) {
+        std::vector<const FieldValue*> rows;
+        rows.reserve(cfg.rows);
+        for (const Chunk& c : kept) {
+            for (size_t r = 0; r < c.values.size(); r += n_fields) {
+                rows.push_back(&c.values[r]);
+            }
+        }
+        t0 = Clock::now();
+        std::sort(rows.begin(), rows.end(), NativeLess{ps});
+        phases.push_back({"tuple_sort", secondsSince(t0), (double)cfg.rows, 0,
+                          rssBytes(), ""});
+
+        // the native order must also be the order of the encoded keys:
+        // row ids from the chunk each row pointer is in
+        std::vector<std::pair<const FieldValue*, size_t>> bases;
+        for (size_t c = 0; c < kept.size(); c++) {
+            bases.emplace_back(kept[c].values.data(), c);
+        }
+        std::sort(bases.begin(), bases.end());
+        auto idOf = [&](const FieldValue* row) {
+            auto it = std::upper_bound(bases.begin(), bases.end(),
+                                       std::make_pair(row, kept.size())) - 1;
+            return it->second * CHUNK_ROWS + (row - it->first) / n_fields;
+        };
+        for (size_t k = 1; k < rows.size(); k++) {
+            if (compareKeys(table.getArena().getKey(handles[idOf(rows[k - 1])]),
+                            table.getArena().getKey(handles[idOf(rows[k])])) > 0) {
+                fprintf(stderr, "tuple and encoded orders differ\n");
+                return 1;
+            }
+        }
+    }
+
+    printf("{\n");
+    printf("  \"rows\": %zu,\n", cfg.rows);
+    printf("  \"schema\": \"%s\",\n", cfg.schema.c_str());
+    printf("  \"nulls\": %g, \"str_len\": [%u, %u], \"zeros\": %g,\n",
+           cfg.nulls, cfg.strMin, cfg.strMax, cfg.zeros);
+    printf("  \"distinct\": %llu, \"skew\": %g, \"sort\": \"%s\", \"threads\": %d,"
+           " \"seed\": %llu,\n",
+           (unsigned long long)(cfg.distinct ? cfg.distinct : cfg.rows),
+           cfg.skew, cfg.sort.c_str(), cfg.threads, (unsigned long long)cfg.seed);
+    printf("  \"encoded_bytes\": %llu, \"avg_key_len\": %.2f, \"max_key_len\": %u,\n",
+           (unsigned long long)enc_bytes, (double)enc_bytes / cfg.rows, max_len);
+    printf("  \"phases\": {\n");
+    for (size_t k = 0; k < phases.size(); k++) {
+        const Phase& p = phases[k];
+        bool per_scan = (p.name == "scan");
+        printf("    \"%s\": {\"seconds\": %.6f, \"%s\": %.0f, \"mb_per_sec\": %.1f,"
+               " \"rss_mb\": %.1f%s%s}%s\n",
+               p.name.c_str(), p.seconds,
+               per_scan ? "scans_per_sec" : "rows_per_sec",
+               p.seconds > 0 ? p.items / p.seconds : 0,
+               p.seconds > 0 ? p.bytes / p.seconds / 1e6 : 0,
+               p.rss / 1e6, p.extra.empty() ? "" : ", ", p.extra.c_str(),
+               k + 1 < phases.size() ? "," : "");
+    }
+    printf("  },\n");
+    printf("  \"peak_rss_mb\": %.1f,\n", peakRssBytes() / 1e6);
+    printf("  \"checksum\": %llu\n", (unsigned long long)sum);
+    printf("}\n");
+    return 0;
+}
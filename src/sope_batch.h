@@ -0,0 +1,285 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include "sope_encode.h"
+
+#include <cstddef>
+
+namespace sope {
+
+// Columnar batch encoding for fixed-width types.
+// Value i of a column is encoded at
+//     (uint8_t*)pBase + i * stride + offset
+// so a column can be written straight into a set of row buffers
+// laid out at a fixed stride (stride == width gives a dense array).
+// The encoded bytes are the same as the scalar encode() overloads.
+//
+// All fixed-width encodings are  big_endian(v ^ mask), where mask is
+// either a constant, or picks between two constants by the sign bit
+// (double). The asc/desc choice is made once per column and the loop
+// only does the XOR and the byte swap, 4 or 8 values at a time with
+// AVX2 (vpshufb).
+
+namespace batch {
+
+// Encode: mask = sign(v) ? neg : pos, then byte swap.
+inline void enc64(const uint64_t* col, size_t n, uint8_t* pOut,
+                  size_t stride, uint64_t neg, uint64_t pos) {
+    size_t i = 0;
+#if defined(SOPE_SIMD_AVX2)
+    const __m256i bswap = _mm256_setr_epi8(
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    const __m256i vneg = _mm256_set1_epi64x((long long)neg);
+    const __m256i vpos = _mm256_set1_epi64x((long long)pos);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(col + i));
+        __m256i s = _mm256_cmpgt_epi64(zero, v);
+        __m256i m = _mm256_or_si256(_mm256_and_si256(s, vneg),
+                                    _mm256_andnot_si256(s, vpos));
+        v = _mm256_shuffle_epi8(_mm256_xor_si256(v, m), bswap);
+        if (stride == sizeof(uint64_t)) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut + i * stride), v);
+        } else {
+            uint64_t tmp[4];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(tmp), v);
+            for (size_t k = 0; k < 4; k++) {
+                memcpy(pOut + (i + k) * stride, tmp + k, sizeof(uint64_t));
+            }
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        uint64_t v = col[i];
+        uint64_t s = (uint64_t)((int64_t)v >> 63);
+        v ^= (s & neg) | (~s & pos);
+        v = _enc64(v);
+        memcpy(pOut + i * stride, &v, sizeof(v));
+    }
+}
+
+// Decode: byte swap, then mask = sign(swapped) ? neg : pos.
+inline void dec64(const uint8_t* pIn, size_t stride, size_t n,
+                  uint64_t* col, uint64_t neg, uint64_t pos) {
+    size_t i = 0;
+#if defined(SOPE_SIMD_AVX2)
+    const __m256i bswap = _mm256_setr_epi8(
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8,
+            7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8);
+    const __m256i vneg = _mm256_set1_epi64x((long long)neg);
+    const __m256i vpos = _mm256_set1_epi64x((long long)pos);
+    const __m256i zero = _mm256_setzero_si256();
+    for (; i + 4 <= n; i += 4) {
+        __m256i v;
+        if (stride == sizeof(uint64_t)) {
+            v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIn + i * stride));
+        } else {
+            uint64_t tmp[4];
+            for (size_t k = 0; k < 4; k++) {
+                memcpy(tmp + k, pIn + (i + k) * stride, sizeof(uint64_t));
+            }
+            v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tmp));
+        }
+        v = _mm256_shuffle_epi8(v, bswap);
+        __m256i s = _mm256_cmpgt_epi64(zero, v);
+        __m256i m = _mm256_or_si256(_mm256_and_si256(s, vneg),
+                                    _mm256_andnot_si256(s, vpos));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(col + i),
+                            _mm256_xor_si256(v, m));
+    }
+#endif
+    for (; i < n; i++) {
+        uint64_t v;
+        memcpy(&v, pIn + i * stride, sizeof(v));
+        v = _dec64(v);
+        uint64_t s = (uint64_t)((int64_t)v >> 63);
+        col[i] = v ^ ((s & neg) | (~s & pos));
+    }
+}
+
+inline void enc32(const uint32_t* col, size_t n, uint8_t* pOut,
+                  size_t stride, uint32_t mask) {
+    size_t i = 0;
+#if defined(SOPE_SIMD_AVX2)
+    const __m256i bswap = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i vmask = _mm256_set1_epi32((int)mask);
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(col + i));
+        v = _mm256_shuffle_epi8(_mm256_xor_si256(v, vmask), bswap);
+        if (stride == sizeof(uint32_t)) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pOut + i * stride), v);
+        } else {
+            uint32_t tmp[8];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(tmp), v);
+            for (size_t k = 0; k < 8; k++) {
+                memcpy(pOut + (i + k) * stride, tmp + k, sizeof(uint32_t));
+            }
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t v = _enc32(col[i] ^ mask);
+        memcpy(pOut + i * stride, &v, sizeof(v));
+    }
+}
+
+inline void dec32(const uint8_t* pIn, size_t stride, size_t n,
+                  uint32_t* col, uint32_t mask) {
+    size_t i = 0;
+#if defined(SOPE_SIMD_AVX2)
+    const __m256i bswap = _mm256_setr_epi8(
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+            3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i vmask = _mm256_set1_epi32((int)mask);
+    for (; i + 8 <= n; i += 8) {
+        __m256i v;
+        if (stride == sizeof(uint32_t)) {
+            v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pIn + i * stride));
+        } else {
+            uint32_t tmp[8];
+            for (size_t k = 0; k < 8; k++) {
+                memcpy(tmp + k, pIn + (i + k) * stride, sizeof(uint32_t));
+            }
+            v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(tmp));
+        }
+        v = _mm256_xor_si256(_mm256_shuffle_epi8(v, bswap), vmask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(col + i), v);
+    }
+#endif
+    for (; i < n; i++) {
+        uint32_t v;
+        memcpy(&v, pIn + i * stride, sizeof(v));
+        col[i] = _dec32(v) ^ mask;
+    }
+}
+
+}
+
+#define _BATCH_OUT(p, offset) (reinterpret_cast<uint8_t*>(p) + (offset))
+#define _BATCH_IN(p, offset)  (reinterpret_cast<const uint8_t*>(p) + (offset))
+
+inline void encode_batch(const int* col, size_t n,
+                         void* pBase, size_t stride, size_t offset,
+                         bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_INT, n, n * 4);
+    batch::enc32(reinterpret_cast<const uint32_t*>(col), n,
+                 _BATCH_OUT(pBase, offset), stride,
+                 asc ? 0x80000000U : 0x7FFFFFFFU);
+}
+
+inline void decode_int_batch(const void* pBase, size_t stride, size_t offset,
+                             size_t n, int* col, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_INT, n, n * 4);
+    batch::dec32(_BATCH_IN(pBase, offset), stride, n,
+                 reinterpret_cast<uint32_t*>(col),
+                 asc ? 0x80000000U : 0x7FFFFFFFU);
+}
+
+// Date uses this for encode
+inline void encode_batch(const long* col, size_t n,
+                         void* pBase, size_t stride, size_t offset,
+                         bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_LONG, n, n * 8);
+    uint64_t mask = asc ? 0x8000000000000000ULL : 0x7FFFFFFFFFFFFFFFULL;
+    batch::enc64(reinterpret_cast<const uint64_t*>(col), n,
+                 _BATCH_OUT(pBase, offset), stride, mask, mask);
+}
+
+inline void decode_long_batch(const void* pBase, size_t stride, size_t offset,
+                              size_t n, long* col, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_LONG, n, n * 8);
+    uint64_t mask = asc ? 0x8000000000000000ULL : 0x7FFFFFFFFFFFFFFFULL;
+    batch::dec64(_BATCH_IN(pBase, offset), stride, n,
+                 reinterpret_cast<uint64_t*>(col), mask, mask);
+}
+
+// See encode(double) for the asc/desc rules; negative numbers
+// select the first mask.
+inline void encode_batch(const double* col, size_t n,
+                         void* pBase, size_t stride, size_t offset,
+                         bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_DOUBLE, n, n * 8);
+    if (asc)
+        batch::enc64(reinterpret_cast<const uint64_t*>(col), n,
+                     _BATCH_OUT(pBase, offset), stride,
+                     0xFFFFFFFFFFFFFFFFULL, 0x8000000000000000ULL);
+    else
+        batch::enc64(reinterpret_cast<const uint64_t*>(col), n,
+                     _BATCH_OUT(pBase, offset), stride,
+                     0, 0x7FFFFFFFFFFFFFFFULL);
+}
+
+inline void decode_double_batch(const void* pBase, size_t stride, size_t offset,
+                                size_t n, double* col, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_DOUBLE, n, n * 8);
+    if (asc)
+        batch::dec64(_BATCH_IN(pBase, offset), stride, n,
+                     reinterpret_cast<uint64_t*>(col),
+                     0x8000000000000000ULL, 0xFFFFFFFFFFFFFFFFULL);
+    else
+        batch::dec64(_BATCH_IN(pBase, offset), stride, n,
+                     reinterpret_cast<uint64_t*>(col),
+                     0, 0x7FFFFFFFFFFFFFFFULL);
+}
+
+#if defined(_SOPE_TYPES_DEFINED)
+#ifdef __APPLE__
+// Mac reports ambiguity between long and Date.
+// Need to explicitly separate them.
+inline void encode_batch(const Date* col, size_t n,
+                         void* pBase, size_t stride, size_t offset,
+                         bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_LONG, n, n * 8);
+    uint64_t mask = asc ? 0x8000000000000000ULL : 0x7FFFFFFFFFFFFFFFULL;
+    batch::enc64(reinterpret_cast<const uint64_t*>(col), n,
+                 _BATCH_OUT(pBase, offset), stride, mask, mask);
+}
+#endif
+
+inline void decode_date_batch(const void* pBase, size_t stride, size_t offset,
+                              size_t n, Date* col, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_LONG, n, n * 8);
+    uint64_t mask = asc ? 0x8000000000000000ULL : 0x7FFFFFFFFFFFFFFFULL;
+    batch::dec64(_BATCH_IN(pBase, offset), stride, n,
+                 reinterpret_cast<uint64_t*>(col), mask, mask);
+}
+
+// Timestamp is uint64_t
+inline void encode_batch(const Timestamp* col, size_t n,
+                         void* pBase, size_t stride, size_t offset,
+                         bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_TIMESTAMP, n, n * 8);
+    uint64_t mask = asc ? 0 : 0xFFFFFFFFFFFFFFFFULL;
+    batch::enc64(col, n, _BATCH_OUT(pBase, offset), stride, mask, mask);
+}
+
+inline void decode_timestamp_batch(const void* pBase, size_t stride, size_t offset,
+                                   size_t n, Timestamp* col, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_TIMESTAMP, n, n * 8);
+    uint64_t mask = asc ? 0 : 0xFFFFFFFFFFFFFFFFULL;
+    batch::dec64(_BATCH_IN(pBase, offset), stride, n, col, mask, mask);
+}
+#endif
+
+#undef _BATCH_OUT
+#undef _BATCH_IN
+
+}
@@ -17,12 +17,23 @@ limitations under the License.
 #pragma once
 
 #include "endian_encode.h"
+#include "sope_simd.h"
 
 #include <cstdint>
 #include <cstring>
 #include <cassert>
 #include <stdlib.h>
 
+#if defined(SOPE_STATS)
+#include "sope_stats.h"
+#else
+#define SOPE_STAT_ENCODED(kind, n, bytes) ((void)0)
+#define SOPE_STAT_DECODED(kind, n, bytes) ((void)0)
+#define SOPE_STAT_BINARY_ENCODED(len, enc_len) ((void)0)
+#define SOPE_STAT_WORKING_BUF(len) ((void)0)
+#define SOPE_STAT_KEY(len) ((void)0)
+#endif
+
 namespace sope {
 
 // padding length for strings and bytes
@@ -45,16 +56,19 @@ namespace sope {
 */
 
 inline uint32_t encode(int ii, bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_INT, 1, 4);
     uint32_t ui = asc ? ii ^ 0x80000000U : ii ^ 0x7FFFFFFFU;
     return _enc32(ui);
 }
 
 inline int decode_int(uint32_t ui, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_INT, 1, 4);
     uint32_t nui = _dec32(ui);
     return asc ? nui ^ 0x80000000U : nui ^ 0x7FFFFFFFU;
 }
 
 inline int decode_int(const void * p, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_INT, 1, 4);
     uint32_t ui = *(reinterpret_cast<const uint32_t*>(p));
     uint32_t nui = _dec32(ui);
     return asc ? nui ^ 0x80000000U : nui ^ 0x7FFFFFFFU;
@@ -62,16 +76,19 @@ inline int decode_int(const void * p, bool asc = true) {
 
 // Date uses this for encode
 inline uint64_t encode(long ll, bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_LONG, 1, 8);
     uint64_t ul = asc ? ll ^ 0x8000000000000000ULL : ll ^ 0x7FFFFFFFFFFFFFFFULL;
     return _enc64(ul);
 }
 
 inline long decode_long(uint64_t ul, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_LONG, 1, 8);
     uint64_t nul = _dec64(ul);
     return asc ? nul ^ 0x8000000000000000ULL : nul ^ 0x7FFFFFFFFFFFFFFFULL;
 }
 
 inline long decode_long(const void* p, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_LONG, 1, 8);
     uint64_t ul = *(reinterpret_cast<const uint64_t*>(p));
     uint64_t nul = _dec64(ul);
     return asc ? nul ^ 0x8000000000000000ULL : nul ^ 0x7FFFFFFFFFFFFFFFULL;
@@ -79,11 +96,13 @@ inline long decode_long(const void* p, bool asc = true) {
 
 #if defined(_SOPE_TYPES_DEFINED)
 inline Date decode_date(uint64_t ul, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_LONG, 1, 8);
     uint64_t nul = _dec64(ul);
     return asc ? nul ^ 0x8000000000000000ULL : nul ^ 0x7FFFFFFFFFFFFFFFULL;
 }
 
 inline Date decode_date(const void* p, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_LONG, 1, 8);
     uint64_t ul = *(reinterpret_cast<const uint64_t*>(p));
     uint64_t nul = _dec64(ul);
     return asc ? nul ^ 0x8000000000000000ULL : nul ^ 0x7FFFFFFFFFFFFFFFULL;
@@ -91,11 +110,13 @@ inline Date decode_date(const void* p, bool asc = true) {
 
 // Timestamp is uint64_t
 inline uint64_t encode(Timestamp ts, bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_TIMESTAMP, 1, 8);
     uint64_t nul = _enc64(ts);
     return asc ? nul : nul ^ 0xFFFFFFFFFFFFFFFFULL;
 }
 
 inline Timestamp decode_timestamp(const void* p, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_TIMESTAMP, 1, 8);
     uint64_t ul = *(reinterpret_cast<const uint64_t*>(p));
     uint64_t nul = _dec64(ul);
     return asc ? nul : nul ^ 0xFFFFFFFFFFFFFFFFULL;
@@ -111,6 +132,7 @@ inline Timestamp decode_timestamp(const void* p, bool asc = true) {
 // flipping all bits except the sign bit results in
 // (0x7F...FF - the number treated as an integer).
 inline uint64_t encode(double dd, bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_DOUBLE, 1, 8);
     uint64_t ud = 0;
     memcpy(&ud, &dd, sizeof(dd));
 
@@ -124,6 +146,7 @@ inline uint64_t encode(double dd, bool asc = true) {
 }
 
 inline double decode_double(uint64_t ul, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_DOUBLE, 1, 8);
     uint64_t ud = _dec64(ul);
     if (asc)
         ud = (ud & 0x8000000000000000ULL)
@@ -138,6 +161,7 @@ inline double decode_double(uint64_t ul, bool asc = true) {
 }
 
 inline double decode_double(const void * p, bool asc = true) {
+    SOPE_STAT_DECODED(KIND_DOUBLE, 1, 8);
     uint64_t ul = *(reinterpret_cast<const uint64_t*>(p));
     uint64_t ud = _dec64(ul);
     if (asc)
@@ -156,6 +180,7 @@ inline double decode_double(const void * p, bool asc = true) {
 // encode a string, a string does not have two consecutive 0 in the middle, end with x0000
 // return the total length, flip bits for descending order
 inline uint32_t encode(const char* ps, uint32_t len, void* pBuf, bool asc = true) {
+    SOPE_STAT_ENCODED(KIND_STRING, 1, len + STRING_PAD_LEN);
     assert(STRING_PAD_LEN == 2);
     if (asc) {
         memcpy(pBuf, ps, (size_t)len);
@@ -173,6 +198,9 @@ inline uint32_t encode(const char* ps, uint32_t len, void* pBuf, bool asc = true
 
 // Get actual size of string
 inline uint32_t get_string_len(const void* p, bool asc = true) {
+#if defined(SOPE_SIMD_SCAN)
+    return simd::find_pair(reinterpret_cast<const uint8_t*>(p), asc ? 0x00 : 0xFF);
+#else
     const char* ps = reinterpret_cast<const char*>(p);
     if (asc) {
         while (true) {
@@ -195,10 +223,20 @@ inline uint32_t get_string_len(const void* p, bool asc = true) {
             }
         }
     }
+#endif
 }
 
 // return the string len without trailing 00 or FF
+// The input is read once, so pBuf only needs to be as large as the
+// encoded bytes; calling get_string_len first is not required.
 inline uint32_t decode_string(const void * p, void* pBuf, bool asc = true) {
+#if defined(SOPE_SIMD_SCAN)
+    uint32_t n = simd::decode_pair_terminated(reinterpret_cast<const uint8_t*>(p),
+                                              reinterpret_cast<uint8_t*>(pBuf),
+                                              asc ? 0x00 : 0xFF);
+    SOPE_STAT_DECODED(KIND_STRING, 1, n + STRING_PAD_LEN);
+    return n;
+#else
     const char* pfrom = reinterpret_cast<const char*>(p);
     char* pto = reinterpret_cast<char*>(pBuf);
     if (asc) {
@@ -222,14 +260,21 @@ inline uint32_t decode_string(const void * p, void* pBuf, bool asc = true) {
             }
         }
     }
-    return pto - reinterpret_cast<char*>(pBuf);
+    uint32_t len = pto - reinterpret_cast<char*>(pBuf);
+    SOPE_STAT_DECODED(KIND_STRING, 1, len + STRING_PAD_LEN);
+    return len;
+#endif
 }
 
 // calculate encoding length for a binary string, which can contain 00 in the middle
 // escaped with 0x00FF, end with 0x0000
 inline uint32_t calc_binary_encoded_len(const void * pb, uint32_t len) {
-    int zero_count = 0;
-    for (uint32_t from = 0; from < len; from++) {
+    uint32_t zero_count = 0;
+    uint32_t from = 0;
+#if defined(SOPE_SIMD)
+    zero_count = simd::count_zeros(reinterpret_cast<const uint8_t*>(pb), len, from);
+#endif
+    for (; from < len; from++) {
        if (*(reinterpret_cast<const uint8_t*>(pb) + from) == 0) {
            zero_count++;
        }
@@ -249,11 +294,19 @@ inline uint32_t calc_string_encoded_len(uint32_t len) {
 // BINARY_PAD_LEN is 2, so append two extra byte
 // In case we change BINARY_PAD_LEN in the future,
 // make sure change here
+// With SIMD enabled, whole blocks are escaped first (see sope_simd.h)
+// and the loops below only handle the tail.
 inline uint32_t encode(const void * pb, uint32_t len, void* pBuf, bool asc = true) {
     assert(BINARY_PAD_LEN == 2);
+    uint32_t from = 0;
     uint32_t to = 0;
+#if defined(SOPE_SIMD)
+    simd::escape_zeros(reinterpret_cast<const uint8_t*>(pb), len,
+                       reinterpret_cast<uint8_t*>(pBuf),
+                       asc ? 0x00 : 0xFF, asc ? 0xFF : 0x00, from, to);
+#endif
     if (asc) {
-        for (uint32_t from = 0; from < len; from++) {
+        for (; from < len; from++) {
            *(reinterpret_cast<uint8_t*>(pBuf) + to) =
                    *(reinterpret_cast<const uint8_t*>(pb) + from);
            if (*(reinterpret_cast<const uint8_t*>(pb) + from) == 0) {
@@ -265,7 +318,7 @@ inline uint32_t encode(const void * pb, uint32_t len, void* pBuf, bool asc = tru
         *(reinterpret_cast<uint8_t*>(pBuf)+to) = 0;
         *(reinterpret_cast<uint8_t*>(pBuf)+to+1) = 0;
     } else {
-        for (uint32_t from = 0; from < len; from++) {
+        for (; from < len; from++) {
            *(reinterpret_cast<uint8_t*>(pBuf) + to) =
                    *(reinterpret_cast<const uint8_t*>(pb) + from) ^ 0xFF;
            if (*(reinterpret_cast<const uint8_t*>(pb) + from) == 0) {
@@ -278,12 +331,18 @@ inline uint32_t encode(const void * pb, uint32_t len, void* pBuf, bool asc = tru
         *(reinterpret_cast<uint8_t*>(pBuf)+to+1) = 0xFF;
     }
 
+    SOPE_STAT_BINARY_ENCODED(len, to + BINARY_PAD_LEN);
     return to + BINARY_PAD_LEN;
 }
 
 // length after decode
 inline uint32_t get_bytes_len(const void* p, bool asc = true) {
     uint32_t len = 0;
+#if defined(SOPE_SIMD_SCAN)
+    simd::scan_escaped(reinterpret_cast<const uint8_t*>(p), nullptr, len,
+                       asc ? 0x00 : 0xFF, asc ? 0xFF : 0x00);
+    return len;
+#else
     const uint8_t* pb = reinterpret_cast<const uint8_t*>(p);
     if (asc) {
         while(true) {
@@ -319,13 +378,22 @@ inline uint32_t get_bytes_len(const void* p, bool asc = true) {
         }
     }
     return len;
+#endif
 }
 
 // return the bytes consumed during decoding, length after decode is in len
+// Like decode_string, pBuf only needs to be as large as the encoded bytes.
 inline uint32_t decode_bytes(const void * p,
                              void* pBuf,
                              uint32_t& len,
                              bool asc = true) {
+#if defined(SOPE_SIMD_SCAN)
+    uint32_t n = simd::scan_escaped(reinterpret_cast<const uint8_t*>(p),
+                                    reinterpret_cast<uint8_t*>(pBuf), len,
+                                    asc ? 0x00 : 0xFF, asc ? 0xFF : 0x00);
+    SOPE_STAT_DECODED(KIND_BINARY, 1, n + BINARY_PAD_LEN);
+    return n;
+#else
     const uint8_t* pfrom = reinterpret_cast<const uint8_t*>(p);
     uint8_t* pto = reinterpret_cast<uint8_t*>(pBuf);
     if (asc) {
@@ -360,7 +428,273 @@ inline uint32_t decode_bytes(const void * p,
         }
     }
     len = pto - reinterpret_cast<uint8_t*>(pBuf);
-    return pfrom - reinterpret_cast<const uint8_t*>(p);
+    uint32_t used = pfrom - reinterpret_cast<const uint8_t*>(p);
+    SOPE_STAT_DECODED(KIND_BINARY, 1, used + BINARY_PAD_LEN);
+    return used;
+#endif
+}
+
+// Bytes taken by an encoded binary value, terminator included,
+// i.e. how far to skip it without decoding.
+inline uint32_t get_bytes_encoded_len(const void* p, bool asc = true) {
+    if (asc) {
+        // every 0x00 is an escape (00 FF) or the terminator (00 00)
+        const char* pc = reinterpret_cast<const char*>(p);
+        const char* q = pc;
+        while (true) {
+            q += strlen(q);
+            if (q[1] == 0) break;
+            if (q[1] != '\xFF') {
+                // If not, hanging happens.
+                // We should abort the process to debug it.
+                abort();
+            }
+            q += 2;
+        }
+        return (uint32_t)(q - pc) + BINARY_PAD_LEN;
+    }
+#if defined(SOPE_SIMD_SCAN)
+    uint32_t len;
+    return simd::scan_escaped(reinterpret_cast<const uint8_t*>(p), nullptr,
+                              len, 0xFF, 0x00) + BINARY_PAD_LEN;
+#else
+    const uint8_t* pb = reinterpret_cast<const uint8_t*>(p);
+    while (true) {
+        if (*pb != 0xFF) {
+            pb++;
+        } else if (*(pb+1) == 0xFF) {
+            break;
+        } else if (*(pb+1) == 0) {
+            pb += 2;
+        } else {
+            // If not, hanging happens.
+            // We should abort the process to debug it.
+            abort();
+        }
+    }
+    return (uint32_t)(pb - reinterpret_cast<const uint8_t*>(p)) + BINARY_PAD_LEN;
+#endif
+}
+
+// An ascending binary value without 0x00 bytes is stored unchanged,
+// followed by 00 00. If the first 0x00 at p is that terminator, the
+// value can be used in place: returns true and its length in len.
+// Otherwise (00 FF, an escaped 0x00) it must be decoded.
+inline bool get_unescaped_bytes_len(const void* p, uint32_t& len) {
+    const char* pc = reinterpret_cast<const char*>(p);
+    size_t off = strlen(pc);
+    if (pc[off + 1] != 0) return false;
+    len = (uint32_t)off;
+    return true;
+}
+
+// Fixed-group encoding of strings and binaries (memcomparable style),
+// an alternative to the terminated formats above, selected per field.
+// The value is cut into groups of GROUP_LEN bytes, the last one padded
+// with 0x00, and each group is followed by a marker byte:
+// GROUP_MARKER_MORE when more groups follow, otherwise the number of
+// significant bytes of the group (0 to GROUP_LEN). An empty value is a
+// group of padding with marker 0.
+//     "abc"  ->  61 62 63 00 00 00 00 00 | 03
+// A value that is a prefix of another sorts first: where it ends, its
+// marker is below the other's (a longer last group, or more groups).
+// Descending order flips every byte.
+// Nothing is escaped, so the size follows from the length alone, and
+// encoding and decoding move whole groups; the only data-dependent
+// branch is the loop over the groups.
+#define GROUP_LEN 8
+#define GROUP_MARKER_MORE 9
+
+inline uint32_t calc_group_encoded_len(uint32_t len) {
+    return ((len + GROUP_LEN - 1) / GROUP_LEN + (len == 0)) * (GROUP_LEN + 1);
+}
+
+// return the total length, calc_group_encoded_len(len)
+inline uint32_t encode_group(const void* pb, uint32_t len, void* pBuf, bool asc = true) {
+    const uint8_t* from = reinterpret_cast<const uint8_t*>(pb);
+    uint8_t* to = reinterpret_cast<uint8_t*>(pBuf);
+    uint64_t flip = asc ? 0 : 0xFFFFFFFFFFFFFFFFULL;
+    // groups followed by more: all but the last, which holds 1 to 8
+    // bytes (0 for an empty value)
+    uint32_t more = (len - (len != 0)) / GROUP_LEN;
+    uint64_t v;
+    for (uint32_t g = 0; g < more; g++) {
+        memcpy(&v, from, GROUP_LEN);
+        v ^= flip;
+        memcpy(to, &v, GROUP_LEN);
+        to[GROUP_LEN] = GROUP_MARKER_MORE ^ (uint8_t)flip;
+        from += GROUP_LEN;
+        to += GROUP_LEN + 1;
+    }
+    uint32_t last = len - more * GROUP_LEN;
+    v = 0;
+    if (last) memcpy(&v, from, last);   // from may be null when empty
+    v ^= flip;
+    memcpy(to, &v, GROUP_LEN);
+    to[GROUP_LEN] = (uint8_t)last ^ (uint8_t)flip;
+    uint32_t enc_len = (more + 1) * (GROUP_LEN + 1);
+    SOPE_STAT_ENCODED(KIND_GROUP, 1, enc_len);
+    return enc_len;
+}
+
+// Bytes taken by a group-encoded value, i.e. how far to skip it.
+inline uint32_t get_group_encoded_len(const void* p, bool asc = true) {
+    const uint8_t* m = reinterpret_cast<const uint8_t*>(p) + GROUP_LEN;
+    const uint8_t more = asc ? GROUP_MARKER_MORE : (uint8_t)~GROUP_MARKER_MORE;
+    while (*m == more) m += GROUP_LEN + 1;
+    return (uint32_t)(m + 1 - reinterpret_cast<const uint8_t*>(p));
+}
+
+// Return the bytes consumed, the length after decode is in len.
+// Whole groups are written, so pBuf needs GROUP_LEN bytes per group,
+// which is less than the encoded bytes. A marker above GROUP_LEN that
+// is not GROUP_MARKER_MORE is taken as a full last group: bad input
+// gives wrong bytes, but never aborts or overruns.
+inline uint32_t decode_group(const void* p, void* pBuf, uint32_t& len, bool asc = true) {
+    const uint8_t* from = reinterpret_cast<const uint8_t*>(p);
+    uint8_t* to = reinterpret_cast<uint8_t*>(pBuf);
+    uint64_t flip = asc ? 0 : 0xFFFFFFFFFFFFFFFFULL;
+    uint64_t v;
+    uint8_t marker;
+    do {
+        memcpy(&v, from, GROUP_LEN);
+        v ^= flip;
+        memcpy(to, &v, GROUP_LEN);
+        marker = from[GROUP_LEN] ^ (uint8_t)flip;
+        from += GROUP_LEN + 1;
+        to += GROUP_LEN;
+    } while (marker == GROUP_MARKER_MORE);
+    uint32_t last = marker < GROUP_LEN ? marker : GROUP_LEN;
+    len = (uint32_t)(to - reinterpret_cast<uint8_t*>(pBuf)) - GROUP_LEN + last;
+    uint32_t used = (uint32_t)(from - reinterpret_cast<const uint8_t*>(p));
+    SOPE_STAT_DECODED(KIND_GROUP, 1, used);
+    return used;
+}
+
+
+// Variable-length integers (varint), an alternative to the fixed
+// 4/8-byte formats above for int, long, Date and Timestamp, selected
+// per field. A header byte gives the sign and the number n (0 to 8) of
+// value bytes that follow, big-endian:
+//     header 0x80 + n   value >= 0, the low n bytes of the value
+//     header 0x7F - n   value < 0, the low n bytes of the value, n
+//                       enough for ~value (-1 has none)
+//     0 -> 80   1 -> 81 01   300 -> 82 01 2C   -1 -> 7F   -2 -> 7E FE
+// Headers order by sign and then by magnitude, and values with the
+// same header have the same length, so the bytes compare as the
+// values, and int and long encode the same value alike. Unsigned
+// values (Timestamp) use the non-negative headers only. Descending
+// order flips every byte. Small values take 1 to 3 bytes instead of
+// 4 or 8; a full 64-bit value takes VARINT_MAX_LEN.
+#define VARINT_MAX_LEN 9
+#define VARINT_HEADER_ZERO 0x80
+
+// value bytes needed by u (0 for 0)
+inline uint32_t varint_bytes(uint64_t u) {
+    return (64 - __builtin_clzll(u | 1) + 7) / 8 - (u == 0);
+}
+
+inline uint32_t calc_varint_encoded_len(long v) {
+    return 1 + varint_bytes(v < 0 ? ~(uint64_t)v : (uint64_t)v);
+}
+
+inline uint32_t calc_uvarint_encoded_len(uint64_t v) {
+    return 1 + varint_bytes(v);
+}
+
+namespace detail {
+// the low n bytes of v, big-endian, after the header
+inline uint32_t put_varint(uint64_t v, uint8_t header, uint32_t n, void* pBuf,
+                           bool asc) {
+    uint8_t* to = reinterpret_cast<uint8_t*>(pBuf);
+    uint64_t flip = asc ? 0 : 0xFFFFFFFFFFFFFFFFULL;
+    uint64_t be = _enc64(v ^ flip);
+    to[0] = header ^ (uint8_t)flip;
+    memcpy(to + 1, reinterpret_cast<uint8_t*>(&be) + 8 - n, n);
+    return 1 + n;
+}
+
+// n bytes at p below fill, the bits of the bytes not stored; read
+// as 8, or 4, 2 and 1 byte pieces by the bits of n
+inline uint64_t get_varint(const uint8_t* p, uint32_t n, uint64_t fill) {
+    uint64_t v = fill;
+    if (n & 8) {
+        memcpy(&v, p, 8);
+        return _dec64(v);
+    }
+    if (n & 4) {
+        uint32_t u;
+        memcpy(&u, p, 4);
+        v = (v << 32) | _dec32(u);
+        p += 4;
+    }
+    if (n & 2) {
+        uint16_t u;
+        memcpy(&u, p, 2);
+        v = (v << 16) | (uint16_t)_dec16(u);
+        p += 2;
+    }
+    if (n & 1) v = (v << 8) | *p;
+    return v;
+}
+}
+
+// return the total length, calc_varint_encoded_len(v)
+inline uint32_t encode_varint(long v, void* pBuf, bool asc = true) {
+    uint64_t neg = (uint64_t)(v >> 63);     // all ones if v < 0
+    uint32_t n = varint_bytes((uint64_t)v ^ neg);
+    uint8_t header = neg ? VARINT_HEADER_ZERO - 1 - n : VARINT_HEADER_ZERO + n;
+    SOPE_STAT_ENCODED(KIND_VARINT, 1, 1 + n);
+    return detail::put_varint((uint64_t)v, header, n, pBuf, asc);
+}
+
+inline uint32_t encode_varint(int v, void* pBuf, bool asc = true) {
+    return encode_varint((long)v, pBuf, asc);
+}
+
+inline uint32_t encode_uvarint(uint64_t v, void* pBuf, bool asc = true) {
+    uint32_t n = varint_bytes(v);
+    SOPE_STAT_ENCODED(KIND_VARINT, 1, 1 + n);
+    return detail::put_varint(v, VARINT_HEADER_ZERO + n, n, pBuf, asc);
+}
+
+// Bytes taken by a varint, from its header only. A header out of
+// range is taken as VARINT_MAX_LEN, here and in the decoders: bad
+// input gives a wrong value, but never reads further.
+inline uint32_t get_varint_encoded_len(const void* p, bool asc = true) {
+    uint8_t h = *reinterpret_cast<const uint8_t*>(p) ^ (asc ? 0 : 0xFF);
+    uint32_t n = h >= VARINT_HEADER_ZERO ? h - VARINT_HEADER_ZERO
+                                         : VARINT_HEADER_ZERO - 1 - h;
+    return 1 + (n < 8 ? n : 8);
+}
+
+// Return the bytes consumed, the value is in v.
+inline uint32_t decode_varint(const void* p, long& v, bool asc = true) {
+    const uint8_t* from = reinterpret_cast<const uint8_t*>(p);
+    uint64_t flip = asc ? 0 : 0xFFFFFFFFFFFFFFFFULL;
+    uint8_t h = from[0] ^ (uint8_t)flip;
+    uint64_t neg = h < VARINT_HEADER_ZERO ? 0xFFFFFFFFFFFFFFFFULL : 0;
+    uint32_t len = get_varint_encoded_len(p, asc);
+    // the bytes not stored are the sign, as encoded
+    v = (long)(detail::get_varint(from + 1, len - 1, neg ^ flip) ^ flip);
+    SOPE_STAT_DECODED(KIND_VARINT, 1, len);
+    return len;
+}
+
+inline uint32_t decode_varint(const void* p, int& v, bool asc = true) {
+    long l;
+    uint32_t len = decode_varint(p, l, asc);
+    v = (int)l;
+    return len;
+}
+
+inline uint32_t decode_uvarint(const void* p, uint64_t& v, bool asc = true) {
+    const uint8_t* from = reinterpret_cast<const uint8_t*>(p);
+    uint64_t flip = asc ? 0 : 0xFFFFFFFFFFFFFFFFULL;
+    uint32_t len = get_varint_encoded_len(p, asc);
+    v = detail::get_varint(from + 1, len - 1, flip) ^ flip;
+    SOPE_STAT_DECODED(KIND_VARINT, 1, len);
+    return len;
 }
 
 }
@@ -0,0 +1,263 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    https://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdlib.h>
+
+// Byte-block primitives used by the variable-length kernels in
+// sope_encode.h. The block width is chosen at compile time:
+// AVX2 (32 bytes) when built with -mavx2 or -march=native,
+// SSE2 (16 bytes) on any x86-64 build, otherwise nothing is
+// defined and the encoders keep their scalar loops only.
+// Define SOPE_NO_SIMD to force the scalar path.
+#if !defined(SOPE_NO_SIMD) && (defined(__GNUC__) || defined(__clang__))
+    #if defined(__AVX2__)
+        #include <immintrin.h>
+        #define SOPE_SIMD_AVX2
+        #define SOPE_SIMD
+    #elif defined(__SSE2__)
+        #include <emmintrin.h>
+        #define SOPE_SIMD_SSE2
+        #define SOPE_SIMD
+    #endif
+#endif
+
+#if defined(SOPE_SIMD)
+
+namespace sope {
+namespace simd {
+
+#if defined(SOPE_SIMD_AVX2)
+typedef __m256i block_t;
+const uint32_t BLOCK_LEN = 32;
+
+inline block_t load(const void* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+inline void store(void* p, block_t b) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), b);
+}
+inline block_t splat(uint8_t c) {
+    return _mm256_set1_epi8((char)c);
+}
+inline block_t bxor(block_t a, block_t b) {
+    return _mm256_xor_si256(a, b);
+}
+// bit i is set if byte i of a equals byte i of b
+inline uint32_t eq_mask(block_t a, block_t b) {
+    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+}
+#else
+typedef __m128i block_t;
+const uint32_t BLOCK_LEN = 16;
+
+inline block_t load(const void* p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+inline void store(void* p, block_t b) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(p), b);
+}
+inline block_t splat(uint8_t c) {
+    return _mm_set1_epi8((char)c);
+}
+inline block_t bxor(block_t a, block_t b) {
+    return _mm_xor_si128(a, b);
+}
+inline uint32_t eq_mask(block_t a, block_t b) {
+    return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+}
+#endif
+
+// Terminator scans load whole aligned blocks, which may extend past
+// the terminator but never across a page boundary (same approach as
+// memchr). Address and memory sanitizers still report those bytes, so
+// sanitized builds keep the scalar scan loops; so do builds with
+// SOPE_NO_SIMD_SCAN (e.g. for valgrind, which cannot be detected at
+// compile time).
+#if defined(__SANITIZE_ADDRESS__)
+    #define SOPE_SANITIZED
+#endif
+#if defined(__has_feature)
+    #if __has_feature(address_sanitizer) || __has_feature(memory_sanitizer)
+        #define SOPE_SANITIZED
+    #endif
+#endif
+#if !defined(SOPE_SANITIZED) && !defined(SOPE_NO_SIMD_SCAN)
+#define SOPE_SIMD_SCAN
+#endif
+
+inline const uint8_t* align_down(const uint8_t* p) {
+    return reinterpret_cast<const uint8_t*>(
+            reinterpret_cast<uintptr_t>(p) & ~(uintptr_t)(BLOCK_LEN - 1));
+}
+
+inline uint32_t lowest_bit(uint32_t mask) {
+    return (uint32_t)__builtin_ctz(mask);
+}
+
+inline uint32_t bit_count(uint32_t mask) {
+    return (uint32_t)__builtin_popcount(mask);
+}
+
+// Count 0x00 bytes in [pb, pb+len), whole blocks only.
+// `from` is advanced to the first byte not examined.
+inline uint32_t count_zeros(const uint8_t* pb, uint32_t len, uint32_t& from) {
+    const block_t zero = splat(0);
+    uint32_t count = 0;
+    for (; from + BLOCK_LEN <= len; from += BLOCK_LEN) {
+        count += bit_count(eq_mask(load(pb + from), zero));
+    }
+    return count;
+}
+
+// Binary escaping of whole blocks: every input byte is written
+// XOR-ed with `flip` (0x00 asc, 0xFF desc), and every 0x00 input
+// byte is followed by `esc` (0xFF asc, 0x00 desc).
+// Zero-free blocks are stored with a single vector write; blocks
+// with zeros copy the runs between them.
+inline void escape_zeros(const uint8_t* pb, uint32_t len, uint8_t* pBuf,
+                         uint8_t flip, uint8_t esc,
+                         uint32_t& from, uint32_t& to) {
+    const block_t zero = splat(0);
+    const block_t vflip = splat(flip);
+    uint8_t tmp[BLOCK_LEN];
+    for (; from + BLOCK_LEN <= len; from += BLOCK_LEN) {
+        block_t b = load(pb + from);
+        uint32_t mask = eq_mask(b, zero);
+        b = bxor(b, vflip);
+        if (mask == 0) {
+            store(pBuf + to, b);
+            to += BLOCK_LEN;
+            continue;
+        }
+        store(tmp, b);
+        uint32_t run = 0;
+        while (mask) {
+            uint32_t z = lowest_bit(mask);
+            memcpy(pBuf + to, tmp + run, z + 1 - run);
+            to += z + 1 - run;
+            pBuf[to++] = esc;
+            run = z + 1;
+            mask &= mask - 1;
+        }
+        memcpy(pBuf + to, tmp + run, BLOCK_LEN - run);
+        to += BLOCK_LEN - run;
+    }
+}
+
+// Emit bytes [from, to) of block b (already XOR-ed) to pto.
+inline void emit(uint8_t* pto, block_t b, uint32_t from, uint32_t to) {
+    if (from == 0 && to == BLOCK_LEN) {
+        store(pto, b);
+    } else {
+        uint8_t tmp[BLOCK_LEN];
+        store(tmp, b);
+        memcpy(pto, tmp + from, to - from);
+    }
+}
+
+// Offset of the first pair of `term` bytes (0x0000 asc, 0xFFFF desc)
+// starting at p, i.e. the length of an encoded string.
+inline uint32_t find_pair(const uint8_t* p, uint8_t term) {
+    const block_t vterm = splat(term);
+    const uint8_t* base = align_down(p);
+    uint32_t skip = (uint32_t)(p - base);
+    uint32_t carry = 0;
+    for (;; base += BLOCK_LEN, skip = 0) {
+        uint32_t mask = eq_mask(load(base), vterm) & (~0U << skip);
+        if (carry && (mask & 1)) return (uint32_t)(base - 1 - p);
+        uint32_t pairs = mask & (mask >> 1);
+        if (pairs) return (uint32_t)(base + lowest_bit(pairs) - p);
+        carry = mask >> (BLOCK_LEN - 1);
+    }
+}
+
+// Same scan as find_pair, copying (and un-flipping) the string
+// bytes to pto on the way. Only the decoded bytes are written.
+inline uint32_t decode_pair_terminated(const uint8_t* p, uint8_t* pto,
+                                       uint8_t term) {
+    const block_t vterm = splat(term);
+    const uint8_t* base = align_down(p);
+    uint32_t skip = (uint32_t)(p - base);
+    uint32_t carry = 0;
+    for (;; base += BLOCK_LEN, skip = 0) {
+        block_t b = load(base);
+        uint32_t mask = eq_mask(b, vterm) & (~0U << skip);
+        uint32_t out = (uint32_t)(base - p);
+        if (carry) {
+            if (mask & 1) return out - 1;
+            // a single terminator byte is a 0x00 in the string
+            pto[out - 1] = 0;
+        }
+        b = bxor(b, vterm);
+        uint32_t pairs = mask & (mask >> 1);
+        if (pairs) {
+            uint32_t end = lowest_bit(pairs);
+            emit(pto + (out + skip), b, skip, end);
+            return out + end;
+        }
+        carry = mask >> (BLOCK_LEN - 1);
+        emit(pto + (out + skip), b, skip, BLOCK_LEN - carry);
+    }
+}
+
+// Scan an escaped binary value: `term` is the byte that starts both
+// the terminator (term, term) and an escape (term, esc).
+// Returns the bytes consumed before the terminator; if pto is not
+// null the decoded bytes are written there. len is the decoded length.
+inline uint32_t scan_escaped(const uint8_t* p, uint8_t* pto, uint32_t& len,
+                             uint8_t term, uint8_t esc) {
+    const block_t vterm = splat(term);
+    const uint8_t* base = align_down(p);
+    uint32_t skip = (uint32_t)(p - base);
+    len = 0;
+    for (;; base += BLOCK_LEN) {
+        block_t b = load(base);
+        uint32_t mask = eq_mask(b, vterm) & (~0U << skip);
+        b = bxor(b, vterm);
+        uint32_t cur = skip;
+        while (mask) {
+            uint32_t k = lowest_bit(mask);
+            if (pto && k > cur) emit(pto + len, b, cur, k);
+            len += k - cur;
+            // base[k+1] may be in the next block; it exists either way
+            uint8_t next = base[k + 1];
+            if (next == term) return (uint32_t)(base + k - p);
+            if (next != esc) {
+                // If not, hanging happens.
+                // We should abort the process to debug it.
+                abort();
+            }
+            if (pto) pto[len] = 0;
+            len++;
+            cur = k + 2;
+            mask &= mask - 1;
+        }
+        if (cur < BLOCK_LEN) {
+            if (pto) emit(pto + len, b, cur, BLOCK_LEN);
+            len += BLOCK_LEN - cur;
+        }
+        skip = (cur > BLOCK_LEN) ? cur - BLOCK_LEN : 0;
+    }
+}
+
+}
+}
+
+#endif
@@ -0,0 +1,210 @@
+/******************************************************************
+Copyright 2019 eBay Inc.
+Architect/Developer(s): Gene Zhang, Jung-Sang Ahn, Kun Ren
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    https://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+******************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+// Optional statistics of the encoders and decoders. Define SOPE_STATS
+// to turn them on: sope_encode.h then includes this file and the
+// SOPE_STAT_* hooks below count; otherwise it does not include it, the
+// hooks expand to nothing and the encoders are unchanged. The
+// functions below report zeros in a build without SOPE_STATS.
+//
+// Counters are per thread and plain (no atomics): a thread counts
+// into its own Stats, reads it with snapshot(), and publishes it with
+// flush(), which adds it to the process totals returned by flushed().
+// The counts of a thread that exits without flush() are lost.
+//
+//     sope::stats::flush();
+//     sope::stats::Stats s = sope::stats::flushed();
+//     export("sope.binary.escape_fraction", s.escapeFraction());
+
+namespace sope {
+namespace stats {
+
+// kinds of values, by encoder
+enum Kind {
+    KIND_INT,
+    KIND_LONG,          // long and Date
+    KIND_DOUBLE,
+    KIND_TIMESTAMP,
+    KIND_BOOL,
+    KIND_STRING,
+    KIND_BINARY,
+    KIND_GROUP,         // strings and binaries in fixed groups
+    KIND_VARINT,        // variable-length integers
+    NUM_KINDS
+};
+
+inline const char* kindName(Kind k) {
+    static const char* names[NUM_KINDS] = {
+        "int", "long", "double", "timestamp", "bool", "string", "binary",
+        "group", "varint"
+    };
+    return names[k];
+}
+
+// key lengths: bucket 0 holds 0, bucket b holds [2^(b-1), 2^b)
+const int KEY_LEN_BUCKETS = 33;
+
+struct Stats {
+    // values and bytes in encoded form, by kind
+    uint64_t encodedValues[NUM_KINDS];
+    uint64_t encodedBytes[NUM_KINDS];
+    uint64_t decodedValues[NUM_KINDS];
+    uint64_t decodedBytes[NUM_KINDS];
+    // binaries encoded: input bytes, and the 0x00 bytes among them,
+    // each escaped by one more byte
+    uint64_t binaryBytes;
+    uint64_t binaryEscapes;
+    // EncodedRecord working buffer (re)allocations, and their bytes
+    uint64_t workingBufAllocs;
+    uint64_t workingBufBytes;
+    // lengths of the keys (records) added to a table
+    uint64_t keyCount;
+    uint64_t keyBytes;
+    uint64_t keyLenBuckets[KEY_LEN_BUCKETS];
+
+    Stats() { reset(); }
+
+    void reset() { memset(this, 0, sizeof(*this)); }
+
+    void merge(const Stats& s) {
+        for (int k = 0; k < NUM_KINDS; k++) {
+            encodedValues[k] += s.encodedValues[k];
+            encodedBytes[k] += s.encodedBytes[k];
+            decodedValues[k] += s.decodedValues[k];
+            decodedBytes[k] += s.decodedBytes[k];
+        }
+        binaryBytes += s.binaryBytes;
+        binaryEscapes += s.binaryEscapes;
+        workingBufAllocs += s.workingBufAllocs;
+        workingBufBytes += s.workingBufBytes;
+        keyCount += s.keyCount;
+        keyBytes += s.keyBytes;
+        for (int b = 0; b < KEY_LEN_BUCKETS; b++) {
+            keyLenBuckets[b] += s.keyLenBuckets[b];
+        }
+    }
+
+    // fraction of the binary input bytes that needed an escape
+    double escapeFraction() const {
+        return binaryBytes ? (double)binaryEscapes / binaryBytes : 0;
+    }
+
+    // Upper bound of the q-quantile (0 <= q <= 1) of the key lengths,
+    // at the resolution of the buckets.
+    uint64_t keyLenQuantile(double q) const {
+        uint64_t rank = (uint64_t)(q * keyCount);
+        uint64_t seen = 0;
+        for (int b = 0; b < KEY_LEN_BUCKETS; b++) {
+            seen += keyLenBuckets[b];
+            if (seen > rank || seen == keyCount) {
+                return b == 0 ? 0 : (1ULL << b) - 1;
+            }
+        }
+        return 0;
+    }
+
+    // the hooks
+    void encoded(Kind k, uint64_t n, uint64_t bytes) {
+        encodedValues[k] += n;
+        encodedBytes[k] += bytes;
+    }
+
+    void decoded(Kind k, uint64_t n, uint64_t bytes) {
+        decodedValues[k] += n;
+        decodedBytes[k] += bytes;
+    }
+
+    // a binary of len bytes encoded in enc_len bytes
+    void binaryEncoded(uint32_t len, uint32_t enc_len) {
+        encoded(KIND_BINARY, 1, enc_len);
+        binaryBytes += len;
+        binaryEscapes += enc_len - len - 2;     // BINARY_PAD_LEN
+    }
+
+    void workingBuf(uint32_t len) {
+        workingBufAllocs++;
+        workingBufBytes += len;
+    }
+
+    void key(uint32_t len) {
+        keyCount++;
+        keyBytes += len;
+        keyLenBuckets[len ? 32 - __builtin_clz(len) : 0]++;
+    }
+};
+
+// the calling thread's counters
+inline Stats& local() {
+    static thread_local Stats s;
+    return s;
+}
+
+inline Stats snapshot() {
+    return local();
+}
+
+namespace detail {
+inline std::mutex& globalLock() {
+    static std::mutex m;
+    return m;
+}
+inline Stats& globalStats() {
+    static Stats s;
+    return s;
+}
+}
+
+// adds the calling thread's counters to the totals, and resets them;
+// a thread must call it before it exits, or its counts are lost
+inline void flush() {
+    Stats& s = local();
+    {
+        std::lock_guard<std::mutex> l(detail::globalLock());
+        detail::globalStats().merge(s);
+    }
+    s.reset();
+}
+
+// totals of the counters flushed so far, by all threads; counts not
+// flushed yet, or never, are not included
+inline Stats flushed() {
+    std::lock_guard<std::mutex> l(detail::globalLock());
+    return detail::globalStats();
+}
+
+inline void resetFlushed() {
+    std::lock_guard<std::mutex> l(detail::globalLock());
+    detail::globalStats().reset();
+}
+
+}
+}
+
+#if defined(SOPE_STATS)
+    // the no-op hooks are in sope_encode.h
+    #define SOPE_STAT_ENCODED(kind, n, bytes) \
+        ::sope::stats::local().encoded(::sope::stats::kind, n, bytes)
+    #define SOPE_STAT_DECODED(kind, n, bytes) \
+        ::sope::stats::local().decoded(::sope::stats::kind, n, bytes)
+    #define SOPE_STAT_BINARY_ENCODED(len, enc_len) \
+        ::sope::stats::local().binaryEncoded(len, enc_len)
+    #define SOPE_STAT_WORKING_BUF(len) ::sope::stats::local().workingBuf(len)
+    #define SOPE_STAT_KEY(len) ::sope::stats::local().key(len)
+#endif